@@ -1,22 +1,68 @@
+#include <algorithm>
 #include <cstdlib>
 #include <limits> 
 #include "ast.hpp"
 
 using namespace gpc;
 
-static double max_value = 9999999;
-static double min_value = -9999999;
+/**
+ * Largest magnitude of numbers and results, every integer up to it is exact as a double (2^53 - 1).
+ */
+static const double max_value = 9007199254740991.0;
+static const double min_value = -9007199254740991.0;
 
-node::node() {
-}
+node::node(size_t depth)
+    : m_references(1), m_depth(depth), m_memo_state(MEMO_EMPTY), m_memo_value(0), m_memo_error(0) {}
 
 node::~node() {
 }
 
-number_node::number_node(int value)
-    : m_value(value) {}
+void node::retain() {
+    m_references++;
+}
+
+void node::release() {
+    if (--m_references == 0) {
+        delete this;
+    }
+}
+
+size_t node::depth() const {
+    return m_depth;
+}
+
+double node::value(budget* budget) {
+    if (budget) {
+        budget->charge_step();
+    }
+
+    if (m_references == 1) {
+        // only one parent, nobody else will ask again
+        return eval(budget);
+    }
+
+    if (m_memo_state == MEMO_VALUE) {
+        return m_memo_value;
+    } else if (m_memo_state == MEMO_ERROR) {
+        throw m_memo_error;
+    }
+
+    try {
+        m_memo_value = eval(budget);
+        m_memo_state = MEMO_VALUE;
+    } catch (const char* exception) {
+        m_memo_error = exception;
+        m_memo_state = MEMO_ERROR;
+        throw;
+    }
+
+    return m_memo_value;
+}
+
+number_node::number_node(long long value)
+    : node(1), m_value(value) {}
 
-double number_node::eval() {
+double number_node::eval(budget* budget) {
     if (m_value < min_value) {
         throw "Number to small.";
     } else if (m_value > max_value) {
@@ -27,30 +73,30 @@ double number_node::eval() {
 }
 
 unary_minus_node::unary_minus_node(node* child)
-    : m_child(child) {}
+    : node(child->depth() + 1), m_child(child) {}
 
 unary_minus_node::~unary_minus_node() {
-    delete m_child;
+    m_child->release();
 }
 
-double unary_minus_node::eval() {
-    return m_child->eval() * -1;
+double unary_minus_node::eval(budget* budget) {
+    return m_child->value(budget) * -1;
 }
 
 op_node_base::op_node_base(node* left, node* right)
-    : m_left(left), m_right(right) {}
+    : node(std::max(left->depth(), right->depth()) + 1), m_left(left), m_right(right) {}
 
 op_node_base::~op_node_base() {
-    delete m_right;
-    delete m_left;
+    m_right->release();
+    m_left->release();
 }
 
 add_op_node::add_op_node(node* left, node* right)
     : op_node_base(left, right) {}
 
-double add_op_node::eval() {
-    double left = m_left->eval();
-    double right = m_right->eval();
+double add_op_node::eval(budget* budget) {
+    double left = m_left->value(budget);
+    double right = m_right->value(budget);
 
     if ((max_value - right) < left) {
         throw "Overflow while adding";
@@ -64,9 +110,9 @@ double add_op_node::eval() {
 sub_op_node::sub_op_node(node* left, node* right)
     : op_node_base(left, right) {}
 
-double sub_op_node::eval() {
-    double left = m_left->eval();
-    double right = m_right->eval();
+double sub_op_node::eval(budget* budget) {
+    double left = m_left->value(budget);
+    double right = m_right->value(budget);
 
     if ((max_value + right) < left) {
         throw "Overflow while subtracting";
@@ -80,9 +126,9 @@ double sub_op_node::eval() {
 mul_op_node::mul_op_node(node* left, node* right)
     : op_node_base(left, right) {}
 
-double mul_op_node::eval() {
-    double left = m_left->eval();
-    double right = m_right->eval();
+double mul_op_node::eval(budget* budget) {
+    double left = m_left->value(budget);
+    double right = m_right->value(budget);
     double left_abs = (left < 0) ? -1.0 * left : left;
     double right_abs = (right < 0) ? -1.0 * right : right;
 
@@ -98,9 +144,9 @@ double mul_op_node::eval() {
 div_op_node::div_op_node(node* left, node* right)
     : op_node_base(left, right) {}
 
-double div_op_node::eval() {
-    double right = m_right->eval();
-    double left = m_left->eval();
+double div_op_node::eval(budget* budget) {
+    double right = m_right->value(budget);
+    double left = m_left->value(budget);
     double right_abs = (right < 0) ? -1.0 * right : right;
 
     if (right_abs <= std::numeric_limits<double>::epsilon()) {
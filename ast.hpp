@@ -1,6 +1,9 @@
 #ifndef __GPC_AST_HPP_INCLUDED__
 #define __GPC_AST_HPP_INCLUDED__
 
+#include <cstddef>
+#include "budget.hpp"
+
 namespace gpc {
 
     /**
@@ -12,7 +15,7 @@ namespace gpc {
         /**
          * Reduced visibility.
          */
-        node();
+        node(size_t depth);
 
     public:
         /**
@@ -20,10 +23,50 @@ namespace gpc {
          */
         virtual ~node();
 
+        /**
+         * Take an additional reference to this node.
+         *
+         * Nodes can be shared between several parents when the parser hash-conses
+         * the syntax tree into a DAG.
+         */
+        void retain();
+
+        /**
+         * Drop a reference and delete the node when it was the last one.
+         */
+        void release();
+
+        /**
+         * Depth of the tree below (and including) this node.
+         */
+        size_t depth() const;
+
+        /**
+         * Evaluate the node through its memo.
+         *
+         * Shared nodes are evaluated only once, later calls return the remembered
+         * value or throw the remembered error again. Each call is charged as one step
+         * to the budget (if any).
+         */
+        double value(budget* budget);
+
         /**
          * Evaluate the node and/or its children.
          */
-        virtual double eval() = 0;
+        virtual double eval(budget* budget) = 0;
+
+    private:
+        enum memo_state {
+            MEMO_EMPTY,
+            MEMO_VALUE,
+            MEMO_ERROR
+        };
+
+        unsigned int m_references;
+        size_t m_depth;
+        memo_state m_memo_state;
+        double m_memo_value;
+        const char* m_memo_error;
     };
 
     /**
@@ -35,15 +78,15 @@ namespace gpc {
         /**
          * Construct a new number_node with the given value.
          */
-        number_node(int value);
+        number_node(long long value);
         
         /**
          * Return the number.
          */
-        double eval();
+        double eval(budget* budget);
 
     private:
-        int m_value;
+        long long m_value;
     };
 
     /**
@@ -65,7 +108,7 @@ namespace gpc {
         /**
          * Return the number.
          */
-        double eval();
+        double eval(budget* budget);
 
     private:
         node* m_child;
@@ -93,7 +136,7 @@ namespace gpc {
     class add_op_node : public op_node_base {
     public:
         add_op_node(node* left, node* right);
-        double eval();
+        double eval(budget* budget);
     };
 
     /**
@@ -102,7 +145,7 @@ namespace gpc {
     class sub_op_node : public op_node_base {
     public:
         sub_op_node(node* left, node* right);
-        double eval();
+        double eval(budget* budget);
     };
 
     /**
@@ -111,7 +154,7 @@ namespace gpc {
     class mul_op_node : public op_node_base {
     public:
         mul_op_node(node* left, node* right);
-        double eval();
+        double eval(budget* budget);
     };
 
     /**
@@ -120,7 +163,7 @@ namespace gpc {
     class div_op_node : public op_node_base {
     public:
         div_op_node(node* left, node* right);
-        double eval();
+        double eval(budget* budget);
     };
 
 }
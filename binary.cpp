@@ -0,0 +1,210 @@
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include "binary.hpp"
+#include "io.hpp"
+
+using namespace gpc;
+
+/**
+ * Reads request frames from a file descriptor through a buffer with read(2).
+ */
+class frame_reader {
+public:
+    frame_reader(int fd) : m_fd(fd), m_pos(0), m_end(0) {}
+
+    /**
+     * Read exactly 'length' bytes, returns false at the end of the input.
+     */
+    bool read(void* data, size_t length) {
+        char* target = static_cast<char*>(data);
+        while (length != 0) {
+            if (m_pos == m_end && !fill()) {
+                return false;
+            }
+            size_t chunk = std::min(length, m_end - m_pos);
+            std::memcpy(target, m_buffer + m_pos, chunk);
+            m_pos += chunk;
+            target += chunk;
+            length -= chunk;
+        }
+
+        return true;
+    }
+
+    /**
+     * Skip exactly 'length' bytes, returns false at the end of the input.
+     */
+    bool skip(size_t length) {
+        while (length != 0) {
+            if (m_pos == m_end && !fill()) {
+                return false;
+            }
+            size_t chunk = std::min(length, m_end - m_pos);
+            m_pos += chunk;
+            length -= chunk;
+        }
+
+        return true;
+    }
+
+    /**
+     * Whether the next frame can be read without waiting for input.
+     */
+    bool buffered() const {
+        binary_request request;
+        if (m_end - m_pos < sizeof(request)) {
+            return false;
+        }
+        std::memcpy(&request, m_buffer + m_pos, sizeof(request));
+
+        return m_end - m_pos - sizeof(request) >= request.length;
+    }
+
+private:
+    int m_fd;
+    size_t m_pos;
+    size_t m_end;
+    char m_buffer[65536];
+
+    /**
+     * Read more input behind what is left, returns false at the end of the input.
+     */
+    bool fill() {
+        std::memmove(m_buffer, m_buffer + m_pos, m_end - m_pos);
+        m_end -= m_pos;
+        m_pos = 0;
+
+        ssize_t length;
+        do {
+            length = ::read(m_fd, m_buffer + m_end, sizeof(m_buffer) - m_end);
+        } while (length < 0 && errno == EINTR);
+
+        if (length <= 0) {
+            return false;
+        }
+        m_end += static_cast<size_t>(length);
+
+        return true;
+    }
+};
+
+/**
+ * Turns a BINARY_TOKENS payload into tokens.
+ *
+ * Returns BINARY_BAD_FRAME on an unknown opcode or a truncated number and
+ * BINARY_LIMIT as soon as there are more than max_tokens tokens (0 means
+ * unlimited), so a huge frame does not turn into a huge token list. The index
+ * of the offending token is stored in 'position' then.
+ */
+static binary_status decode_tokens(const std::string& payload, size_t max_tokens, token_vector_t& tokens, size_t& position) {
+    tokens.clear();
+
+    for (size_t i = 0; i < payload.length(); i++) {
+        if (max_tokens != 0 && tokens.size() == max_tokens) {
+            position = tokens.size();
+            return BINARY_LIMIT;
+        }
+
+        switch (payload[i]) {
+            case BINARY_PLUS:
+                tokens.push_back(token(TOKEN_PLUS, "+"));
+                break;
+            case BINARY_MINUS:
+                tokens.push_back(token(TOKEN_MINUS, "-"));
+                break;
+            case BINARY_MULTIPLY:
+                tokens.push_back(token(TOKEN_MULTIPLY, "*"));
+                break;
+            case BINARY_DIVIDE:
+                tokens.push_back(token(TOKEN_DIVIDE, "/"));
+                break;
+            case BINARY_NUMBER: {
+                int64_t number;
+                if (payload.length() - i - 1 < sizeof(number)) {
+                    position = tokens.size();
+                    return BINARY_BAD_FRAME;
+                }
+                std::memcpy(&number, payload.data() + i + 1, sizeof(number));
+                tokens.push_back(token(static_cast<long long>(number)));
+                i += sizeof(number);
+                break;
+            }
+            default:
+                position = tokens.size();
+                return BINARY_BAD_FRAME;
+        }
+    }
+
+    return BINARY_VALUE;
+}
+
+void gpc::binary_serve(int in_fd, int out_fd, const evaluation_options& options) {
+    frame_reader in(in_fd);
+    output_buffer out(out_fd);
+    binary_request request;
+    binary_response response;
+    std::string payload;
+    token_vector_t tokens;
+    outcome result;
+
+    size_t max_payload = binary_max_payload;
+    if (options.limits.max_bytes != 0) {
+        max_payload = std::min(max_payload, options.limits.max_bytes);
+    }
+
+    for (;;) {
+        if (!in.buffered()) {
+            // answer everything so far before waiting for more input
+            out.flush();
+        }
+
+        if (!in.read(&request, sizeof(request))) {
+            break;
+        }
+
+        response.id = request.id;
+        response.position = binary_no_position;
+        response.value = 0;
+
+        if (request.length > max_payload) {
+            // skipped without looking at it, so a huge frame costs no memory
+            if (!in.skip(request.length)) {
+                break;
+            }
+            response.status = BINARY_LIMIT;
+        } else {
+            payload.resize(request.length);
+            if (!in.read(&payload[0], payload.length())) {
+                break;
+            }
+
+            size_t position = no_position;
+            binary_status decoded = BINARY_BAD_FRAME;
+            if (request.kind == BINARY_EXPRESSION) {
+                evaluate(payload, options, result, request.id);
+            } else if (request.kind == BINARY_TOKENS
+                    && (decoded = decode_tokens(payload, options.limits.max_tokens, tokens, position)) == BINARY_VALUE) {
+                evaluate(tokens, options, result, request.id);
+            } else {
+                response.status = decoded;
+                if (position != no_position) {
+                    response.position = static_cast<uint32_t>(position);
+                }
+                out.write(reinterpret_cast<const char*>(&response), sizeof(response));
+                continue;
+            }
+
+            response.status = result.kind;
+            if (result.kind == OUTCOME_VALUE) {
+                response.value = result.value;
+            } else if (result.position != no_position) {
+                response.position = static_cast<uint32_t>(result.position);
+            }
+        }
+
+        out.write(reinterpret_cast<const char*>(&response), sizeof(response));
+    }
+}
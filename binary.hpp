@@ -0,0 +1,103 @@
+#ifndef __GPC_BINARY_HPP_INCLUDED__
+#define __GPC_BINARY_HPP_INCLUDED__
+
+#include <cstddef>
+#include <stdint.h>
+#include "evaluation.hpp"
+
+namespace gpc {
+
+    /**
+     * Longest payload of a request frame, longer frames are skipped and answered with BINARY_LIMIT.
+     */
+    const uint32_t binary_max_payload = 1 << 24;
+
+    /**
+     * Position of responses which did not fail at a token.
+     */
+    const uint32_t binary_no_position = 0xffffffff;
+
+    /**
+     * Different kinds of request frames.
+     */
+    enum binary_frame_kind {
+        /**
+         * The payload is an expression like a line of text (without '\n').
+         */
+        BINARY_EXPRESSION = 0,
+
+        /**
+         * The payload is a list of opcodes, the tokenizer is skipped.
+         */
+        BINARY_TOKENS = 1
+    };
+
+    /**
+     * Opcodes of a BINARY_TOKENS payload, one byte each.
+     */
+    enum binary_opcode {
+        BINARY_PLUS = '+',
+        BINARY_MINUS = '-',
+        BINARY_MULTIPLY = '*',
+        BINARY_DIVIDE = '/',
+
+        /**
+         * Followed by the number as int64_t (unaligned).
+         */
+        BINARY_NUMBER = '#'
+    };
+
+    /**
+     * Status of a response frame.
+     */
+    enum binary_status {
+        BINARY_VALUE = OUTCOME_VALUE,
+        BINARY_ERROR = OUTCOME_ERROR,
+        BINARY_LIMIT = OUTCOME_LIMIT,
+
+        /**
+         * Unknown frame kind or a broken BINARY_TOKENS payload.
+         */
+        BINARY_BAD_FRAME = 3
+    };
+
+    /**
+     * Header of a request frame, followed by 'length' bytes of payload.
+     *
+     * All fields are in host byte order, the protocol is meant for clients on the same host.
+     */
+    struct binary_request {
+        uint32_t length;
+        uint32_t kind;
+        uint64_t id;
+    };
+
+    /**
+     * A response frame, one for every request in the order of the requests.
+     */
+    struct binary_response {
+        uint64_t id;
+        uint32_t status;
+
+        /**
+         * Index of the token at which the request failed or binary_no_position.
+         */
+        uint32_t position;
+
+        /**
+         * The result if the status is BINARY_VALUE.
+         */
+        double value;
+    };
+
+    /**
+     * Answer the request frames read from in_fd with response frames on out_fd until the end of the input.
+     *
+     * Responses are collected and written when no complete request is left in the
+     * input buffer, so a batch of requests costs a single read and write.
+     */
+    void binary_serve(int in_fd, int out_fd, const evaluation_options& options);
+
+}
+
+#endif //__GPC_BINARY_HPP_INCLUDED__
@@ -0,0 +1,99 @@
+#include <time.h>
+#include "budget.hpp"
+
+using namespace gpc;
+
+/**
+ * The clock is read once every that many charges.
+ */
+static const unsigned int ticks_per_clock_check = 256;
+
+/**
+ * Current value of the monotonic clock in microseconds.
+ */
+static long long now_us() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return static_cast<long long>(now.tv_sec) * 1000000 + now.tv_nsec / 1000;
+}
+
+limits::limits()
+    : max_bytes(0), max_tokens(0), max_nodes(0), max_depth(default_max_depth), max_steps(0), max_time_us(0) {}
+
+limit_exceeded::limit_exceeded(const char* message)
+    : message(message) {}
+
+budget::budget(const limits& limits)
+    : m_limits(limits), m_tokens(0), m_nodes(0), m_steps(0), m_ticks(0),
+      m_deadline_us(limits.max_time_us ? now_us() + limits.max_time_us : 0), m_remaining_us(0) {}
+
+void budget::restart() {
+    m_tokens = 0;
+    m_nodes = 0;
+    m_steps = 0;
+    m_ticks = 0;
+    m_deadline_us = m_limits.max_time_us ? now_us() + m_limits.max_time_us : 0;
+}
+
+void budget::pause() {
+    if (m_deadline_us) {
+        m_remaining_us = m_deadline_us - now_us();
+    }
+}
+
+void budget::resume() {
+    if (m_deadline_us) {
+        m_deadline_us = now_us() + m_remaining_us;
+    }
+}
+
+void budget::charge_bytes(size_t bytes) {
+    if (m_limits.max_bytes && bytes > m_limits.max_bytes) {
+        throw limit_exceeded("Line too long");
+    }
+}
+
+void budget::charge_token() {
+    m_tokens++;
+    if (m_limits.max_tokens && m_tokens > m_limits.max_tokens) {
+        throw limit_exceeded("Too many tokens");
+    }
+    tick();
+}
+
+void budget::charge_node() {
+    m_nodes++;
+    if (m_limits.max_nodes && m_nodes > m_limits.max_nodes) {
+        throw limit_exceeded("Too many nodes");
+    }
+    tick();
+}
+
+void budget::charge_step() {
+    m_steps++;
+    if (m_limits.max_steps && m_steps > m_limits.max_steps) {
+        throw limit_exceeded("Too many evaluation steps");
+    }
+    tick();
+}
+
+void budget::check_depth(size_t depth) {
+    if (m_limits.max_depth && depth > m_limits.max_depth) {
+        throw limit_exceeded("Nested too deep");
+    }
+}
+
+size_t budget::tokens() const {
+    return m_tokens;
+}
+
+size_t budget::nodes() const {
+    return m_nodes;
+}
+
+void budget::tick() {
+    if (m_deadline_us && ++m_ticks % ticks_per_clock_check == 0 && now_us() > m_deadline_us) {
+        throw limit_exceeded("Deadline exceeded");
+    }
+}
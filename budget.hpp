@@ -0,0 +1,131 @@
+#ifndef __GPC_BUDGET_HPP_INCLUDED__
+#define __GPC_BUDGET_HPP_INCLUDED__
+
+#include <cstddef>
+
+namespace gpc {
+
+    /**
+     * Depth limit unless another one is given.
+     *
+     * eval() and the destruction of the syntax tree recurse through its depth, so
+     * an unlimited depth would let a long enough line overflow the stack.
+     */
+    const size_t default_max_depth = 10000;
+
+    /**
+     * Resource limits for a single line, 0 means unlimited.
+     */
+    struct limits {
+        limits();
+
+        /**
+         * Length of the input line.
+         */
+        size_t max_bytes;
+
+        /**
+         * Number of tokens.
+         */
+        size_t max_tokens;
+
+        /**
+         * Number of nodes in the syntax tree.
+         */
+        size_t max_nodes;
+
+        /**
+         * Depth of the syntax tree (and therefore of the recursion in parser and eval()).
+         *
+         * default_max_depth unless set otherwise.
+         */
+        size_t max_depth;
+
+        /**
+         * Number of evaluated nodes.
+         */
+        size_t max_steps;
+
+        /**
+         * Wall-clock time for the whole line in microseconds.
+         */
+        long long max_time_us;
+    };
+
+    /**
+     * Thrown when a line exceeds one of its limits.
+     *
+     * Deliberately not a plain string like the other errors so it can be told apart.
+     */
+    struct limit_exceeded {
+        limit_exceeded(const char* message);
+        const char* message;
+    };
+
+    /**
+     * Accounts the resources used by one line against its limits.
+     *
+     * The tokenizer, the parser and eval() charge it while they work. The clock
+     * is only looked at every few charges to keep the checks cheap.
+     */
+    class budget {
+    public:
+
+        /**
+         * Start a new budget, the time starts running now.
+         */
+        budget(const limits& limits);
+
+        /**
+         * Start over with nothing charged, the time starts running again.
+         */
+        void restart();
+
+        /**
+         * Stop the time, the line waits for something else than its own work.
+         */
+        void pause();
+
+        /**
+         * Let the paused time run on, the wait since pause() does not count.
+         */
+        void resume();
+
+        void charge_bytes(size_t bytes);
+        void charge_token();
+        void charge_node();
+        void charge_step();
+        void check_depth(size_t depth);
+
+        /**
+         * Number of tokens charged so far.
+         */
+        size_t tokens() const;
+
+        /**
+         * Number of nodes charged so far.
+         */
+        size_t nodes() const;
+
+    private:
+        const limits& m_limits;
+        size_t m_tokens;
+        size_t m_nodes;
+        size_t m_steps;
+        unsigned int m_ticks;
+        long long m_deadline_us;
+
+        /**
+         * Time which was left at pause().
+         */
+        long long m_remaining_us;
+
+        /**
+         * Look at the clock every few charges.
+         */
+        void tick();
+    };
+
+}
+
+#endif //__GPC_BUDGET_HPP_INCLUDED__
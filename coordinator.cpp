@@ -0,0 +1,446 @@
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "coordinator.hpp"
+#include "io.hpp"
+
+using namespace gpc;
+
+/**
+ * Number of shards a worker may have in flight.
+ */
+static const size_t shards_in_flight = 4;
+
+/**
+ * A line which killed that many workers on its own is not tried again.
+ */
+static const unsigned int max_crashes = 2;
+
+/**
+ * Answer for a line which kills the workers.
+ */
+#ifdef NYAN_CAT_IS_WATCHING
+static const char crash_answer[] = "ERROR: Worker crashed";
+#else
+static const char crash_answer[] = "ERROR";
+#endif
+
+/**
+ * Answer for a line longer than max_bytes, the same as without workers.
+ */
+#ifdef NYAN_CAT_IS_WATCHING
+static const char too_long_answer[] = "LIMIT: Line too long";
+#else
+static const char too_long_answer[] = "LIMIT";
+#endif
+
+coordinator_options::coordinator_options()
+    : workers(1), shard_lines(64), worker_lines(1000000), max_bytes(0) {}
+
+/**
+ * An input line waiting for its answer.
+ */
+struct pending_line {
+    pending_line(const std::string& text) : text(text), done(false), isolated(false), crashes(0) {}
+    std::string text;
+    std::string answer;
+    bool done;
+
+    /**
+     * Set for the lines of a crashed worker, they are sent alone to find the culprit.
+     */
+    bool isolated;
+    unsigned int crashes;
+};
+
+/**
+ * The coordinator side of a worker process.
+ */
+struct worker_process {
+    worker_process() : pid(-1), to_fd(-1), from_fd(-1), outgoing_pos(0), answered(0) {}
+    pid_t pid;
+    int to_fd;
+    int from_fd;
+
+    /**
+     * Lines sent and not answered yet, in the order the worker answers them.
+     */
+    std::deque<uint64_t> in_flight;
+    std::string outgoing;
+    size_t outgoing_pos;
+    std::string incoming;
+    size_t answered;
+};
+
+/**
+ * Put a file descriptor into non-blocking mode.
+ */
+static void set_nonblocking(int fd) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+class coordinator {
+public:
+    coordinator(int in_fd, int out_fd, const coordinator_options& options, worker_function worker, void* context)
+        : m_in_fd(in_fd), m_out(out_fd), m_options(options), m_worker(worker), m_context(context),
+          m_workers(options.workers), m_base(0), m_input_done(false) {}
+
+    int run();
+
+private:
+    int m_in_fd;
+
+    /**
+     * The beginning of a line whose end was not read yet, at most max_bytes + 1 bytes of it.
+     */
+    std::string m_partial;
+    output_buffer m_out;
+    const coordinator_options& m_options;
+    worker_function m_worker;
+    void* m_context;
+    std::vector<worker_process> m_workers;
+
+    /**
+     * Lines from m_base on which are not written yet.
+     */
+    std::deque<pending_line> m_lines;
+    uint64_t m_base;
+
+    /**
+     * Lines waiting for a worker, new ones and those of dead workers.
+     */
+    std::deque<uint64_t> m_unassigned;
+    bool m_input_done;
+
+    bool spawn(worker_process& process);
+    void stop(worker_process& process);
+    void died(worker_process& process);
+    void read_input();
+    void add_line(const std::string& text);
+    void assign();
+    void send(worker_process& process);
+    bool write_to(worker_process& process);
+    bool read_from(worker_process& process);
+    void answer(uint64_t line, const std::string& answer);
+    void emit();
+
+    pending_line& line(uint64_t number) {
+        return m_lines[number - m_base];
+    }
+
+    size_t window() const {
+        return m_options.workers * m_options.shard_lines * shards_in_flight * 2;
+    }
+};
+
+bool coordinator::spawn(worker_process& process) {
+    int to_child[2];
+    int from_child[2];
+    if (pipe(to_child) != 0) {
+        return false;
+    }
+    if (pipe(from_child) != 0) {
+        close(to_child[0]);
+        close(to_child[1]);
+        return false;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(to_child[0]);
+        close(to_child[1]);
+        close(from_child[0]);
+        close(from_child[1]);
+        return false;
+    }
+
+    if (pid == 0) {
+        close(to_child[1]);
+        close(from_child[0]);
+        for (std::vector<worker_process>::iterator it = m_workers.begin(); it != m_workers.end(); it++) {
+            if (it->pid > 0) {
+                close(it->to_fd);
+                close(it->from_fd);
+            }
+        }
+        m_worker(to_child[0], from_child[1], m_context);
+        _exit(EXIT_SUCCESS);
+    }
+
+    close(to_child[0]);
+    close(from_child[1]);
+    set_nonblocking(to_child[1]);
+    set_nonblocking(from_child[0]);
+
+    process.pid = pid;
+    process.to_fd = to_child[1];
+    process.from_fd = from_child[0];
+    process.outgoing.clear();
+    process.outgoing_pos = 0;
+    process.incoming.clear();
+    process.answered = 0;
+
+    return true;
+}
+
+void coordinator::stop(worker_process& process) {
+    close(process.to_fd);
+    close(process.from_fd);
+    waitpid(process.pid, 0, 0);
+    process.pid = -1;
+}
+
+void coordinator::died(worker_process& process) {
+    stop(process);
+
+    if (process.in_flight.size() == 1) {
+        // the line was sent alone, so it is the culprit
+        uint64_t number = process.in_flight.front();
+        if (++line(number).crashes >= max_crashes) {
+            answer(number, crash_answer);
+        } else {
+            m_unassigned.push_front(number);
+        }
+    } else {
+        // answers buffered by the worker are lost as well, any of the lines could be the culprit
+        for (std::deque<uint64_t>::iterator it = process.in_flight.begin(); it != process.in_flight.end(); it++) {
+            line(*it).isolated = true;
+        }
+        m_unassigned.insert(m_unassigned.begin(), process.in_flight.begin(), process.in_flight.end());
+    }
+    process.in_flight.clear();
+}
+
+/**
+ * Read what is there without waiting, the input is only read when poll() says it is readable.
+ */
+void coordinator::read_input() {
+    char buffer[65536];
+    ssize_t length = read(m_in_fd, buffer, sizeof(buffer));
+    if (length < 0 && (errno == EINTR || errno == EAGAIN)) {
+        return;
+    } else if (length <= 0) {
+        if (m_partial.length() != 0) {
+            // the last line has no '\n'
+            add_line(m_partial);
+        }
+        m_input_done = true;
+        return;
+    }
+
+    const char* begin = buffer;
+    const char* end = buffer + length;
+    while (begin != end && !m_input_done) {
+        const char* newline = static_cast<const char*>(std::memchr(begin, '\n', end - begin));
+        size_t part = (newline ? newline : end) - begin;
+        if (m_options.max_bytes != 0) {
+            // keep one byte too many, so the line is still known to be too long
+            size_t room = (m_partial.length() <= m_options.max_bytes) ? m_options.max_bytes + 1 - m_partial.length() : 0;
+            m_partial.append(begin, std::min(part, room));
+        } else {
+            m_partial.append(begin, part);
+        }
+
+        if (!newline) {
+            break;
+        }
+        begin = newline + 1;
+
+        if (m_partial.length() == 0) {
+            // an empty line ends the input
+            m_input_done = true;
+        } else {
+            add_line(m_partial);
+            m_partial.clear();
+        }
+    }
+}
+
+void coordinator::add_line(const std::string& text) {
+    m_lines.push_back(pending_line(text));
+
+    if (m_options.max_bytes != 0 && text.length() > m_options.max_bytes) {
+        // no need to bother a worker with it
+        m_lines.back().answer = too_long_answer;
+        m_lines.back().done = true;
+    } else {
+        m_unassigned.push_back(m_base + m_lines.size() - 1);
+    }
+}
+
+void coordinator::assign() {
+    for (std::vector<worker_process>::iterator it = m_workers.begin(); it != m_workers.end() && !m_unassigned.empty(); it++) {
+        bool retiring = m_options.worker_lines && it->answered + it->in_flight.size() >= m_options.worker_lines;
+        if (it->pid <= 0 || retiring) {
+            continue;
+        }
+
+        if (line(m_unassigned.front()).isolated) {
+            if (it->in_flight.empty()) {
+                send(*it);
+            }
+            continue;
+        }
+
+        while (it->in_flight.size() + m_options.shard_lines <= m_options.shard_lines * shards_in_flight) {
+            for (size_t i = 0; i < m_options.shard_lines && !m_unassigned.empty() && !line(m_unassigned.front()).isolated; i++) {
+                send(*it);
+            }
+            if (m_unassigned.empty() || line(m_unassigned.front()).isolated) {
+                break;
+            }
+        }
+    }
+}
+
+void coordinator::send(worker_process& process) {
+    uint64_t number = m_unassigned.front();
+    m_unassigned.pop_front();
+    process.in_flight.push_back(number);
+    process.outgoing += line(number).text;
+    process.outgoing += '\n';
+}
+
+bool coordinator::write_to(worker_process& process) {
+    while (process.outgoing_pos < process.outgoing.length()) {
+        ssize_t result = write(process.to_fd, process.outgoing.data() + process.outgoing_pos, process.outgoing.length() - process.outgoing_pos);
+        if (result < 0) {
+            return errno == EAGAIN || errno == EINTR;
+        }
+        process.outgoing_pos += static_cast<size_t>(result);
+    }
+
+    process.outgoing.clear();
+    process.outgoing_pos = 0;
+
+    return true;
+}
+
+bool coordinator::read_from(worker_process& process) {
+    char buffer[65536];
+    ssize_t result = read(process.from_fd, buffer, sizeof(buffer));
+    if (result < 0) {
+        return errno == EAGAIN || errno == EINTR;
+    } else if (result == 0) {
+        return false;
+    }
+
+    process.incoming.append(buffer, static_cast<size_t>(result));
+
+    size_t start = 0;
+    for (size_t end = process.incoming.find('\n'); end != std::string::npos; end = process.incoming.find('\n', start)) {
+        if (!process.in_flight.empty()) {
+            answer(process.in_flight.front(), process.incoming.substr(start, end - start));
+            process.in_flight.pop_front();
+            process.answered++;
+        }
+        start = end + 1;
+    }
+    process.incoming.erase(0, start);
+
+    return true;
+}
+
+void coordinator::answer(uint64_t number, const std::string& answer) {
+    pending_line& pending = line(number);
+    pending.answer = answer;
+    pending.done = true;
+}
+
+void coordinator::emit() {
+    while (!m_lines.empty() && m_lines.front().done) {
+        m_out.write(m_lines.front().answer);
+        m_out.put('\n');
+        m_lines.pop_front();
+        m_base++;
+    }
+}
+
+int coordinator::run() {
+    // a dead worker shows up as EPIPE on write and EOF on read
+    std::signal(SIGPIPE, SIG_IGN);
+
+    for (std::vector<worker_process>::iterator it = m_workers.begin(); it != m_workers.end(); it++) {
+        if (!spawn(*it)) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::vector<pollfd> fds;
+    while (!m_input_done || !m_lines.empty()) {
+        assign();
+
+        fds.clear();
+        bool wants_input = !m_input_done && m_lines.size() < window();
+        if (wants_input) {
+            pollfd fd = { m_in_fd, POLLIN, 0 };
+            fds.push_back(fd);
+        }
+        for (std::vector<worker_process>::iterator it = m_workers.begin(); it != m_workers.end(); it++) {
+            pollfd fd = { it->from_fd, POLLIN, 0 };
+            fds.push_back(fd);
+            if (!it->outgoing.empty()) {
+                pollfd out = { it->to_fd, POLLOUT, 0 };
+                fds.push_back(out);
+            }
+        }
+
+        m_out.flush();
+        if (poll(&fds[0], fds.size(), -1) < 0 && errno != EINTR) {
+            return EXIT_FAILURE;
+        }
+
+        std::vector<pollfd>::const_iterator fd = fds.begin();
+        if (wants_input) {
+            if (fd->revents) {
+                read_input();
+            }
+            fd++;
+        }
+        for (std::vector<worker_process>::iterator it = m_workers.begin(); it != m_workers.end(); it++) {
+            bool alive = true;
+            if (fd->revents) {
+                alive = read_from(*it);
+            }
+            fd++;
+            if (!it->outgoing.empty()) {
+                if (alive && fd->revents) {
+                    alive = write_to(*it);
+                }
+                fd++;
+            }
+
+            bool retired = m_options.worker_lines && it->answered >= m_options.worker_lines && it->in_flight.empty();
+            if (!alive || retired) {
+                died(*it);
+                if (!spawn(*it)) {
+                    return EXIT_FAILURE;
+                }
+            }
+        }
+
+        emit();
+    }
+
+    for (std::vector<worker_process>::iterator it = m_workers.begin(); it != m_workers.end(); it++) {
+        stop(*it);
+    }
+
+    return EXIT_SUCCESS;
+}
+
+int gpc::coordinate(int in_fd, int out_fd, const coordinator_options& options, worker_function worker, void* context) {
+    coordinator coordinator(in_fd, out_fd, options, worker, context);
+
+    return coordinator.run();
+}
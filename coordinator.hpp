@@ -0,0 +1,53 @@
+#ifndef __GPC_COORDINATOR_HPP_INCLUDED__
+#define __GPC_COORDINATOR_HPP_INCLUDED__
+
+#include <cstddef>
+
+namespace gpc {
+
+    /**
+     * Runs in a forked worker process and answers every line read from in_fd
+     * with exactly one line on out_fd until in_fd is closed.
+     */
+    typedef void (*worker_function)(int in_fd, int out_fd, void* context);
+
+    /**
+     * Settings of the coordinator.
+     */
+    struct coordinator_options {
+        coordinator_options();
+
+        /**
+         * Number of worker processes.
+         */
+        unsigned int workers;
+
+        /**
+         * Number of consecutive lines handed to a worker at once.
+         */
+        size_t shard_lines;
+
+        /**
+         * A worker is replaced by a fresh process after that many lines, which
+         * bounds the memory it can leak (0 means never).
+         */
+        size_t worker_lines;
+
+        /**
+         * Lines longer than that are answered with LIMIT right away (0 means no limit).
+         */
+        size_t max_bytes;
+    };
+
+    /**
+     * Distribute the lines of in_fd (up to the first empty line) over forked
+     * worker processes and write their answers to out_fd in input order.
+     *
+     * A worker which dies is replaced and gets the lines it had not answered
+     * yet again. A line which kills a worker twice is answered with ERROR.
+     */
+    int coordinate(int in_fd, int out_fd, const coordinator_options& options, worker_function worker, void* context);
+
+}
+
+#endif //__GPC_COORDINATOR_HPP_INCLUDED__
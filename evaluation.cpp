@@ -0,0 +1,117 @@
+#include <utility>
+#include "evaluation.hpp"
+#include "parser.hpp"
+#include "trace.hpp"
+
+using namespace gpc;
+
+evaluation_options::evaluation_options()
+    : share_nodes(false) {}
+
+outcome::outcome()
+    : kind(OUTCOME_VALUE), value(0), position(no_position) {}
+
+staged_evaluation::staged_evaluation(const evaluation_options& options)
+    : m_options(options), m_budget(options.limits), m_root(0) {}
+
+staged_evaluation::~staged_evaluation() {
+    release();
+}
+
+void staged_evaluation::release() {
+    if (m_root) {
+        m_root->release();
+        m_root = 0;
+    }
+}
+
+bool staged_evaluation::parse(const std::string& line, outcome& result, uint64_t id, uint32_t client) {
+    return parse(line, 0, result, id, client);
+}
+
+bool staged_evaluation::parse(token_vector_t& tokens, outcome& result, uint64_t id) {
+    static const std::string no_line;
+    return parse(no_line, &tokens, result, id, 0);
+}
+
+/**
+ * Tokenize (unless there are tokens already) and parse a line.
+ */
+bool staged_evaluation::parse(const std::string& line, token_vector_t* tokens, outcome& result, uint64_t id, uint32_t client) {
+    release();
+    m_trace.start(line, id, client, tokens ? SPAN_PARSER : SPAN_TOKENIZER);
+    m_budget.restart();
+    result.position = no_position;
+    token_vector_t line_tokens;
+
+    try {
+        if (tokens) {
+            for (size_t i = 0; i < tokens->size(); i++) {
+                m_budget.charge_token();
+            }
+        } else {
+            tokenizer tokenizer(line, &m_budget, &result.position);
+            line_tokens.swap(tokenizer.tokens());
+            tokens = &line_tokens;
+            m_trace.next_stage();
+        }
+        parser parser(std::move(*tokens), m_options.share_nodes, &m_budget, &result.position);
+        // keep the tree alive when the parser goes away
+        m_root = parser.ast();
+        m_root->retain();
+        m_trace.next_stage();
+        m_budget.pause();
+        return true;
+    } catch(const limit_exceeded& exception) {
+        result.kind = OUTCOME_LIMIT;
+        result.message = exception.message;
+    } catch(const char* exception) {
+        result.kind = OUTCOME_ERROR;
+        result.message = exception;
+    } catch(const std::string& exception) {
+        result.kind = OUTCOME_ERROR;
+        result.message = exception;
+    }
+
+    m_trace.finish(result.kind, m_budget.tokens(), m_budget.nodes());
+    return false;
+}
+
+void staged_evaluation::eval(outcome& result) {
+    // the line may have waited for another thread since parse()
+    m_trace.resume();
+    m_budget.resume();
+
+    try {
+        result.value = m_root->eval(&m_budget);
+        m_trace.next_stage();
+        result.kind = OUTCOME_VALUE;
+        result.message.clear();
+    } catch(const limit_exceeded& exception) {
+        result.kind = OUTCOME_LIMIT;
+        result.message = exception.message;
+    } catch(const char* exception) {
+        result.kind = OUTCOME_ERROR;
+        result.message = exception;
+    } catch(const std::string& exception) {
+        result.kind = OUTCOME_ERROR;
+        result.message = exception;
+    }
+
+    release();
+    m_trace.finish(result.kind, m_budget.tokens(), m_budget.nodes());
+}
+
+void gpc::evaluate(const std::string& line, const evaluation_options& options, outcome& result, uint64_t id, uint32_t client) {
+    staged_evaluation evaluation(options);
+    if (evaluation.parse(line, result, id, client)) {
+        evaluation.eval(result);
+    }
+}
+
+void gpc::evaluate(token_vector_t& tokens, const evaluation_options& options, outcome& result, uint64_t id) {
+    staged_evaluation evaluation(options);
+    if (evaluation.parse(tokens, result, id)) {
+        evaluation.eval(result);
+    }
+}
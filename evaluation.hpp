@@ -0,0 +1,133 @@
+#ifndef __GPC_EVALUATION_HPP_INCLUDED__
+#define __GPC_EVALUATION_HPP_INCLUDED__
+
+#include <string>
+#include <stdint.h>
+#include "budget.hpp"
+#include "tokenizer.hpp"
+#include "trace.hpp"
+
+namespace gpc {
+
+    class node;
+
+    /**
+     * Settings for evaluating lines.
+     */
+    struct evaluation_options {
+        evaluation_options();
+
+        /**
+         * Share identical subtrees while parsing.
+         */
+        bool share_nodes;
+
+        /**
+         * Resource limits for each line.
+         */
+        gpc::limits limits;
+    };
+
+    /**
+     * Error position of outcomes which did not fail at a token.
+     */
+    const size_t no_position = static_cast<size_t>(-1);
+
+    /**
+     * Different kinds of outcomes of a line.
+     */
+    enum outcome_kind {
+        /**
+         * The line was evaluated to a value.
+         */
+        OUTCOME_VALUE,
+
+        /**
+         * The line could not be tokenized, parsed or evaluated.
+         */
+        OUTCOME_ERROR,
+
+        /**
+         * The line exceeded one of its limits.
+         */
+        OUTCOME_LIMIT
+    };
+
+    /**
+     * Outcome of evaluating a line.
+     */
+    struct outcome {
+        outcome();
+        enum outcome_kind kind;
+        double value;
+        std::string message;
+
+        /**
+         * Index of the token at which tokenizing or parsing failed, otherwise no_position.
+         */
+        size_t position;
+    };
+
+    /**
+     * A line on its way through the stages of evaluate().
+     *
+     * The stages can run on different threads one after the other. The syntax tree
+     * is owned by the object from parse() until eval(), so it can be handed over
+     * between threads without copying.
+     */
+    class staged_evaluation {
+    public:
+        staged_evaluation(const evaluation_options& options);
+
+        /**
+         * Release a syntax tree which was not evaluated.
+         */
+        ~staged_evaluation();
+
+        /**
+         * Tokenize and parse a line.
+         *
+         * Returns false if that failed already, the outcome is set then.
+         */
+        bool parse(const std::string& line, outcome& result, uint64_t id = 0, uint32_t client = 0);
+
+        /**
+         * Parse already tokenized input, the tokens are charged to the budget.
+         *
+         * The tokens are moved into the parser and left empty.
+         */
+        bool parse(token_vector_t& tokens, outcome& result, uint64_t id = 0);
+
+        /**
+         * Evaluate the syntax tree of a successful parse() and release it.
+         */
+        void eval(outcome& result);
+
+    private:
+        const evaluation_options& m_options;
+        budget m_budget;
+        line_trace m_trace;
+        node* m_root;
+
+        bool parse(const std::string& line, token_vector_t* tokens, outcome& result, uint64_t id, uint32_t client);
+        void release();
+    };
+
+    /**
+     * Tokenize, parse and evaluate a line.
+     *
+     * Errors in the line do not throw but end up in the outcome. The id (like the
+     * line number) and the shm client (if any) identify the line when tracing.
+     */
+    void evaluate(const std::string& line, const evaluation_options& options, outcome& result, uint64_t id = 0, uint32_t client = 0);
+
+    /**
+     * Parse and evaluate already tokenized input, the tokens are charged to the budget.
+     *
+     * The tokens are moved into the parser and left empty.
+     */
+    void evaluate(token_vector_t& tokens, const evaluation_options& options, outcome& result, uint64_t id = 0);
+
+}
+
+#endif //__GPC_EVALUATION_HPP_INCLUDED__
@@ -0,0 +1,237 @@
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include "formatter.hpp"
+
+using namespace gpc;
+
+/**
+ * A word with its precomputed length.
+ */
+struct word {
+    const char* text;
+    size_t length;
+};
+
+#define WORD(text) { text, sizeof(text) - 1 }
+
+/**
+ * Lexical numbers from 'zero' to 'nineteen'.
+ */
+static const word small_numbers[20] = {
+    WORD("zero"), WORD("one"), WORD("two"), WORD("three"), WORD("four"), WORD("five"), WORD("six"), WORD("seven"), WORD("eight"), WORD("nine"),
+    WORD("ten"), WORD("eleven"), WORD("twelve"), WORD("thirteen"), WORD("fourteen"), WORD("fifteen"), WORD("sixteen"), WORD("seventeen"), WORD("eighteen"), WORD("nineteen")
+};
+
+/**
+ * Lexical tenners by their first digit.
+ */
+static const word tenners[10] = {
+    { 0, 0 }, { 0, 0 }, WORD("twenty"), WORD("thirty"), WORD("forty"), WORD("fifty"), WORD("sixty"), WORD("seventy"), WORD("eighty"), WORD("ninety")
+};
+
+/**
+ * Number of groups of three digits which can be spelled.
+ */
+static const int scale_count = 5;
+
+/**
+ * Names of the scales from the biggest to the smallest.
+ */
+static const word scale_names[scale_count] = {
+    WORD("trillion"), WORD("billion"), WORD("million"), WORD("thousand"), { 0, 0 }
+};
+
+static const word minus_word = WORD("minus");
+static const word hundred_word = WORD("hundred");
+static const word and_word = WORD("and");
+static const word point_word = WORD("point");
+
+#undef WORD
+
+/**
+ * Values from this magnitude on are not exact and can not be parsed back (2^53).
+ */
+static const double words_limit = 9007199254740992.0;
+
+/**
+ * Number of spelled decimals of fractional values.
+ */
+static const long long fraction_scale = 1000000;
+
+/**
+ * Integral values below this magnitude are exactly representable and written digit by digit.
+ */
+static const double exact_integer_limit = 9007199254740992.0;
+
+/**
+ * Appends words separated by single spaces to a fixed buffer.
+ */
+struct word_writer {
+    word_writer(char* buffer, size_t size)
+        : begin(buffer), pos(buffer), end(buffer + size), overflow(false) {}
+
+    void append(const word& next) {
+        if (static_cast<size_t>(end - pos) < next.length + 1) {
+            overflow = true;
+            return;
+        }
+        if (pos != begin) {
+            *pos++ = ' ';
+        }
+        std::memcpy(pos, next.text, next.length);
+        pos += next.length;
+    }
+
+    char* begin;
+    char* pos;
+    char* end;
+    bool overflow;
+};
+
+/**
+ * Spells 1 to 99.
+ */
+static void write_below_hundred(word_writer& writer, int value) {
+    if (value < 20) {
+        writer.append(small_numbers[value]);
+    } else {
+        writer.append(tenners[value / 10]);
+        if (value % 10 != 0) {
+            writer.append(small_numbers[value % 10]);
+        }
+    }
+}
+
+/**
+ * Spells 1 to 9999, from 1000 on like 'ninety hundred and seven'.
+ */
+static void write_group(word_writer& writer, int value) {
+    int hundreds = value / 100;
+    int rest = value % 100;
+
+    if (hundreds != 0) {
+        write_below_hundred(writer, hundreds);
+        writer.append(hundred_word);
+        if (rest != 0) {
+            writer.append(and_word);
+        }
+    }
+    if (rest != 0) {
+        write_below_hundred(writer, rest);
+    }
+}
+
+size_t gpc::format_words(double value, char* buffer, size_t size) {
+    double magnitude = std::fabs(value);
+    if (!(magnitude < words_limit)) {
+        return 0;
+    }
+
+    long long integer = static_cast<long long>(magnitude);
+    long long fraction = static_cast<long long>(std::floor((magnitude - integer) * fraction_scale + 0.5));
+    if (fraction == fraction_scale) {
+        integer++;
+        fraction = 0;
+    }
+    if (integer >= words_limit) {
+        return 0;
+    }
+
+    word_writer writer(buffer, size);
+
+    if (value < 0 && (integer != 0 || fraction != 0)) {
+        writer.append(minus_word);
+    }
+
+    if (integer == 0) {
+        writer.append(small_numbers[0]);
+    } else {
+        // split into groups of three digits, groups[0] belonging to the biggest scale
+        // takes all of the remaining digits (up to 9007 trillion)
+        int groups[scale_count];
+        long long rest = integer;
+        for (int i = scale_count - 1; i > 0; i--) {
+            groups[i] = static_cast<int>(rest % 1000);
+            rest /= 1000;
+        }
+        groups[0] = static_cast<int>(rest);
+
+        bool written = false;
+        for (int i = 0; i < scale_count; i++) {
+            if (groups[i] == 0) {
+                continue;
+            }
+            if (written && i == scale_count - 1 && groups[i] < 100) {
+                // two million *and* five
+                writer.append(and_word);
+            }
+            write_group(writer, groups[i]);
+            if (scale_names[i].text) {
+                writer.append(scale_names[i]);
+            }
+            written = true;
+        }
+    }
+
+    if (fraction != 0) {
+        writer.append(point_word);
+        long long digits = fraction_scale / 10;
+        while (fraction != 0) {
+            writer.append(small_numbers[fraction / digits]);
+            fraction %= digits;
+            digits /= 10;
+        }
+    }
+
+    return writer.overflow ? 0 : static_cast<size_t>(writer.pos - writer.begin);
+}
+
+/**
+ * Returns 10^exponent, exact for the exponents of a precision (up to 17).
+ */
+static double power_of_ten(int exponent) {
+    double result = 1;
+    while (exponent-- > 0) {
+        result *= 10;
+    }
+
+    return result;
+}
+
+size_t gpc::format_number(double value, char* buffer, size_t size, int precision) {
+    double magnitude = std::fabs(value);
+
+    if (magnitude < exact_integer_limit && magnitude == std::floor(magnitude)
+            && (precision == 0 || magnitude < power_of_ten(precision))) {
+        char digits[20];
+        char* digit = digits + sizeof(digits);
+        long long integer = static_cast<long long>(magnitude);
+
+        do {
+            *--digit = static_cast<char>('0' + integer % 10);
+            integer /= 10;
+        } while (integer != 0);
+
+        size_t sign = std::signbit(value) ? 1 : 0;
+        size_t length = static_cast<size_t>(digits + sizeof(digits) - digit);
+        if (size < sign + length) {
+            return 0;
+        }
+        if (sign) {
+            buffer[0] = '-';
+        }
+        std::memcpy(buffer + sign, digit, length);
+
+        return sign + length;
+    }
+
+    std::to_chars_result result = (precision == 0)
+        ? std::to_chars(buffer, buffer + size, value)
+        : std::to_chars(buffer, buffer + size, value, std::chars_format::general, precision);
+    if (result.ec != std::errc()) {
+        return 0;
+    }
+
+    return static_cast<size_t>(result.ptr - buffer);
+}
@@ -0,0 +1,42 @@
+#ifndef __GPC_FORMATTER_HPP_INCLUDED__
+#define __GPC_FORMATTER_HPP_INCLUDED__
+
+#include <cstddef>
+
+namespace gpc {
+
+    /**
+     * A buffer of this size is always big enough for format_words().
+     */
+    const size_t words_buffer_size = 512;
+
+    /**
+     * Writes the value as english numerals into the buffer.
+     *
+     * This is the inverse of the lexical numbers the parser accepts, like
+     * 'minus two million three hundred thousand and five'. Fractional values are
+     * rounded to six decimals which are spelled one by one after 'point', like
+     * 'three point three three three three three three'.
+     *
+     * Returns the number of characters written (without a terminating zero) or 0
+     * if the value is not finite, has a magnitude of 2^53 or above, or does not
+     * fit into the buffer. Trillions from 1000 on are spelled with a multiplied
+     * hundred, like 'twenty hundred trillion'.
+     */
+    size_t format_words(double value, char* buffer, size_t size);
+
+    /**
+     * Writes the value as a decimal number into the buffer.
+     *
+     * Values are written with the shortest representation which reads back as
+     * exactly the same double, or rounded to 'precision' significant digits if it
+     * is not 0. Integral values which need no rounding are written digit by digit.
+     *
+     * Returns the number of characters written (without a terminating zero) or 0
+     * if it does not fit into the buffer.
+     */
+    size_t format_number(double value, char* buffer, size_t size, int precision = 0);
+
+}
+
+#endif //__GPC_FORMATTER_HPP_INCLUDED__
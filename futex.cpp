@@ -0,0 +1,34 @@
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include <climits>
+#include "futex.hpp"
+
+using namespace gpc;
+
+// the futex syscall operates on plain 32 bit words
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "atomic words must be plain words");
+
+void gpc::futex_wait(std::atomic<uint32_t>& word, uint32_t expected, long timeout_ms) {
+    struct timespec timeout;
+    timeout.tv_sec = timeout_ms / 1000;
+    timeout.tv_nsec = (timeout_ms % 1000) * 1000000;
+
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT, expected, timeout_ms ? &timeout : 0, 0, 0);
+}
+
+/**
+ * Polls to spin on machines with more than one CPU.
+ */
+static const unsigned int spins_on_multiple_cpus = 20000;
+
+unsigned int gpc::futex_spins() {
+    static const unsigned int spins = (sysconf(_SC_NPROCESSORS_ONLN) > 1) ? spins_on_multiple_cpus : 0;
+
+    return spins;
+}
+
+void gpc::futex_wake(std::atomic<uint32_t>& word) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE, INT_MAX, 0, 0, 0);
+}
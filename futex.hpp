@@ -0,0 +1,32 @@
+#ifndef __GPC_FUTEX_HPP_INCLUDED__
+#define __GPC_FUTEX_HPP_INCLUDED__
+
+#include <atomic>
+#include <stdint.h>
+
+namespace gpc {
+
+    /**
+     * Sleep while the word still has the expected value, at most timeout_ms
+     * milliseconds (0 means no timeout).
+     *
+     * Works across processes as long as the word lives in shared memory.
+     */
+    void futex_wait(std::atomic<uint32_t>& word, uint32_t expected, long timeout_ms = 0);
+
+    /**
+     * Number of polls worth spinning before going to sleep on a futex.
+     *
+     * Spinning only pays off if the other side runs on another CPU, so this is
+     * 0 on single CPU machines.
+     */
+    unsigned int futex_spins();
+
+    /**
+     * Wake up all waiters sleeping on the word.
+     */
+    void futex_wake(std::atomic<uint32_t>& word);
+
+}
+
+#endif //__GPC_FUTEX_HPP_INCLUDED__
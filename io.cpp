@@ -0,0 +1,109 @@
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include "io.hpp"
+
+using namespace gpc;
+
+/**
+ * Write all of the data, retrying after interruptions and partial writes.
+ */
+static void write_all(int fd, const char* data, size_t length) {
+    while (length != 0) {
+        ssize_t result = write(fd, data, length);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        } else if (result <= 0) {
+            return;
+        }
+        data += result;
+        length -= static_cast<size_t>(result);
+    }
+}
+
+line_reader::line_reader(int fd)
+    : m_fd(fd), m_pos(0), m_end(0) {}
+
+bool line_reader::fill() {
+    ssize_t length;
+    do {
+        length = read(m_fd, m_buffer, sizeof(m_buffer));
+    } while (length < 0 && errno == EINTR);
+
+    m_pos = 0;
+    m_end = (length > 0) ? static_cast<size_t>(length) : 0;
+
+    return m_end != 0;
+}
+
+bool line_reader::next(std::string& line, size_t max_bytes) {
+    bool found = false;
+    line.clear();
+
+    for (;;) {
+        if (m_pos == m_end && !fill()) {
+            return found;
+        }
+        found = true;
+
+        const char* begin = m_buffer + m_pos;
+        const char* newline = static_cast<const char*>(std::memchr(begin, '\n', m_end - m_pos));
+        size_t length = newline ? static_cast<size_t>(newline - begin) : m_end - m_pos;
+
+        if (max_bytes != 0 && line.length() + length > max_bytes + 1) {
+            line.append(begin, (line.length() <= max_bytes) ? max_bytes + 1 - line.length() : 0);
+        } else {
+            line.append(begin, length);
+        }
+
+        if (newline) {
+            m_pos += length + 1;
+            return true;
+        }
+        m_pos = m_end;
+    }
+}
+
+bool line_reader::buffered() const {
+    return std::memchr(m_buffer + m_pos, '\n', m_end - m_pos) != 0;
+}
+
+output_buffer::output_buffer(int fd)
+    : m_fd(fd), m_length(0) {}
+
+output_buffer::~output_buffer() {
+    flush();
+}
+
+void output_buffer::write(const char* data, size_t length) {
+    if (m_length + length > sizeof(m_buffer)) {
+        flush();
+        if (length > sizeof(m_buffer)) {
+            write_all(m_fd, data, length);
+            return;
+        }
+    }
+
+    std::memcpy(m_buffer + m_length, data, length);
+    m_length += length;
+}
+
+void output_buffer::write(const char* text) {
+    write(text, std::strlen(text));
+}
+
+void output_buffer::write(const std::string& text) {
+    write(text.data(), text.length());
+}
+
+void output_buffer::put(char c) {
+    if (m_length == sizeof(m_buffer)) {
+        flush();
+    }
+    m_buffer[m_length++] = c;
+}
+
+void output_buffer::flush() {
+    write_all(m_fd, m_buffer, m_length);
+    m_length = 0;
+}
@@ -0,0 +1,81 @@
+#ifndef __GPC_IO_HPP_INCLUDED__
+#define __GPC_IO_HPP_INCLUDED__
+
+#include <cstddef>
+#include <string>
+
+namespace gpc {
+
+    /**
+     * Reads lines from a file descriptor through a buffer with read(2).
+     *
+     * Used instead of iostreams, which are slow to initialize and slow to use.
+     */
+    class line_reader {
+    public:
+
+        /**
+         * Construct a new reader for the given file descriptor.
+         */
+        line_reader(int fd);
+
+        /**
+         * Read the next line (without '\n') into 'line'.
+         *
+         * At most max_bytes + 1 characters of the line are kept if max_bytes is not
+         * 0, the rest of the line is skipped. Returns false at the end of the input.
+         */
+        bool next(std::string& line, size_t max_bytes = 0);
+
+        /**
+         * Whether the next line can be read without waiting for input.
+         */
+        bool buffered() const;
+
+    private:
+        int m_fd;
+        size_t m_pos;
+        size_t m_end;
+        char m_buffer[65536];
+
+        /**
+         * Read more input, returns false at the end of the input.
+         */
+        bool fill();
+    };
+
+    /**
+     * Collects output and writes it to a file descriptor in big chunks with write(2).
+     */
+    class output_buffer {
+    public:
+
+        /**
+         * Construct a new buffer for the given file descriptor.
+         */
+        output_buffer(int fd);
+
+        /**
+         * Flush what is left.
+         */
+        ~output_buffer();
+
+        void write(const char* data, size_t length);
+        void write(const char* text);
+        void write(const std::string& text);
+        void put(char c);
+
+        /**
+         * Write everything collected so far.
+         */
+        void flush();
+
+    private:
+        int m_fd;
+        size_t m_length;
+        char m_buffer[65536];
+    };
+
+}
+
+#endif //__GPC_IO_HPP_INCLUDED__
@@ -0,0 +1,113 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include <time.h>
+#include "shm_client.hpp"
+
+using namespace gpc;
+
+/**
+ * Expressions sent round robin.
+ */
+static const char* const expressions[] = {
+    "twelve times thirty",
+    "1 + 2 * 3",
+    "two million three hundred thousand and five divided by 7",
+    "100 - 99 * 2",
+    "1 / 0"
+};
+
+static const size_t expression_count = sizeof(expressions) / sizeof(expressions[0]);
+
+/**
+ * Current value of the monotonic clock in nanoseconds.
+ */
+static long long now_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return static_cast<long long>(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+/**
+ * Send 'requests' requests with at most 'depth' in flight and record the round-trip latencies.
+ */
+static void run_client(const char* name, unsigned int requests, unsigned int depth, std::vector<long long>* latencies) {
+    try {
+        shm_client client(name);
+        std::vector<long long> sent(requests);
+        shm_response response;
+        unsigned int submitted = 0;
+        unsigned int received = 0;
+
+        latencies->reserve(requests);
+        while (received < requests) {
+            while (submitted < requests && submitted - received < depth) {
+                const char* expression = expressions[submitted % expression_count];
+                sent[submitted] = now_ns();
+                if (!client.submit(submitted, expression, std::strlen(expression))) {
+                    break;
+                }
+                submitted++;
+            }
+
+            if (submitted == received) {
+                // the request ring is full of requests of other clients
+                std::this_thread::yield();
+                continue;
+            }
+
+            client.wait(response);
+            latencies->push_back(now_ns() - sent[response.id]);
+            received++;
+        }
+    } catch (const char* exception) {
+        std::fprintf(stderr, "gpc-load: %s\n", exception);
+    }
+}
+
+int main(int argc, const char* argv[]) {
+    if (argc < 2) {
+        std::fprintf(stderr, "usage: gpc-load NAME [CLIENTS] [REQUESTS] [DEPTH]\n");
+        std::fprintf(stderr, "  sends REQUESTS requests (100000) from each of CLIENTS clients (1) with at most DEPTH (1)\n");
+        std::fprintf(stderr, "  in flight to a server started with 'gpc --shm NAME'\n");
+        return EXIT_FAILURE;
+    }
+
+    const char* name = argv[1];
+    unsigned int clients = (argc > 2) ? std::atoi(argv[2]) : 1;
+    unsigned int requests = (argc > 3) ? std::atoi(argv[3]) : 100000;
+    unsigned int depth = (argc > 4) ? std::atoi(argv[4]) : 1;
+    depth = std::max(1u, std::min(depth, shm_response_slots));
+
+    std::vector<std::vector<long long> > latencies(clients);
+    std::vector<std::thread> threads;
+    long long start = now_ns();
+    for (unsigned int i = 0; i < clients; i++) {
+        threads.push_back(std::thread(run_client, name, requests, depth, &latencies[i]));
+    }
+    for (unsigned int i = 0; i < clients; i++) {
+        threads[i].join();
+    }
+    long long elapsed = now_ns() - start;
+
+    std::vector<long long> all;
+    for (unsigned int i = 0; i < clients; i++) {
+        all.insert(all.end(), latencies[i].begin(), latencies[i].end());
+    }
+    if (all.empty()) {
+        return EXIT_FAILURE;
+    }
+    std::sort(all.begin(), all.end());
+
+    std::printf("requests:   %zu\n", all.size());
+    std::printf("throughput: %.0f requests/s\n", all.size() * 1e9 / elapsed);
+    std::printf("latency:    p50 %.2f us, p99 %.2f us, p99.9 %.2f us, max %.2f us\n",
+        all[all.size() / 2] / 1e3, all[all.size() * 99 / 100] / 1e3,
+        all[all.size() * 999 / 1000] / 1e3, all.back() / 1e3);
+
+    return EXIT_SUCCESS;
+}
@@ -1,37 +1,319 @@
-#include <iostream>
+#include <unistd.h>
+#include <cctype>
+#include <cerrno>
+#include <csignal>
 #include <cstdlib>
-#include "parser.hpp"
+#include <cstring>
+#include <vector>
+#include "binary.hpp"
+#include "coordinator.hpp"
+#include "evaluation.hpp"
+#include "formatter.hpp"
+#include "io.hpp"
+#include "pipeline.hpp"
+#include "shm_server.hpp"
+#include "trace.hpp"
 
 using namespace gpc;
 
-static void error(const std::string& msg) {
+/**
+ * How results are printed.
+ */
+struct print_options {
+    print_options() : words(false), precision(0) {}
+    bool words;
+    int precision;
+};
+
+static void error(output_buffer& out, const char* kind, const std::string& msg) {
+    out.write(kind);
 #ifdef NYAN_CAT_IS_WATCHING
-    std::cout << "ERROR: " << msg << "\n";
-#else
-    std::cout << "ERROR\n";
+    out.write(": ");
+    out.write(msg);
 #endif
+    out.put('\n');
 }
 
-int main (int argc, const char* argv[]) {
-    
+/**
+ * Print the result (or error) of a line.
+ */
+static void print(output_buffer& out, const outcome& result, const print_options& print_options) {
+    if (result.kind == OUTCOME_LIMIT) {
+        error(out, "LIMIT", result.message);
+    } else if (result.kind == OUTCOME_ERROR) {
+        error(out, "ERROR", result.message);
+    } else {
+        char buffer[words_buffer_size];
+        size_t length = print_options.words ? format_words(result.value, buffer, sizeof(buffer))
+                                            : format_number(result.value, buffer, sizeof(buffer), print_options.precision);
+        if (length == 0) {
+            error(out, "ERROR", "Can not format the result");
+        } else {
+            out.write(buffer, length);
+            out.put('\n');
+        }
+    }
+}
+
+static void print_result(output_buffer& out, const outcome& result, const void* context) {
+    print(out, result, *static_cast<const print_options*>(context));
+}
+
+/**
+ * Set by SIGINT and SIGTERM to stop serving.
+ */
+static volatile std::sig_atomic_t stop = 0;
+
+static void request_stop(int) {
+    stop = 1;
+}
+
+/**
+ * Serve requests of co-located clients through a new shared memory segment.
+ */
+static int serve_shm(const char* name, const evaluation_options& options) {
+    shm_segment* segment;
+    try {
+        segment = shm_create(name);
+    } catch (const char* exception) {
+        output_buffer err(STDERR_FILENO);
+        err.write("gpc: ");
+        err.write(exception);
+        err.write(" '");
+        err.write(name);
+        err.write("'\n");
+        return EXIT_FAILURE;
+    }
+
+    std::signal(SIGINT, request_stop);
+    std::signal(SIGTERM, request_stop);
+    shm_serve(*segment, options, stop);
+
+    shm_detach(segment);
+    shm_remove(name);
+
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Complain about two options which can not be used together.
+ */
+static int conflict(const char* option, const char* other) {
+    output_buffer err(STDERR_FILENO);
+    err.write("gpc: ");
+    err.write(option);
+    err.write(" can not be combined with ");
+    err.write(other);
+    err.put('\n');
+
+    return EXIT_FAILURE;
+}
+
+/**
+ * Parse the decimal number argument of an option, returns false if it is none or does not fit.
+ */
+template <typename T>
+static bool parse_count(const char* text, T& count) {
+    if (!std::isdigit(static_cast<unsigned char>(*text))) {
+        return false;
+    }
+
+    char* end;
+    errno = 0;
+    unsigned long long value = std::strtoull(text, &end, 10);
+    count = static_cast<T>(value);
+
+    return *end == '\0' && errno == 0 && count >= 0 && static_cast<unsigned long long>(count) == value;
+}
+
+static void usage() {
+    output_buffer err(STDERR_FILENO);
+    err.write("usage: gpc [--dag] [--words] [--precision N] [limits] [-e EXPR]... [--shm NAME] [--binary] [--pipeline] [--trace FILE] [--workers N]\n");
+    err.write("  --dag            share identical subexpressions while parsing\n");
+    err.write("  --words          print the results as english numerals\n");
+    err.write("  --precision N    print N significant digits (1-17) instead of the shortest exact result\n");
+    err.write("  --max-bytes N    limit the length of a line\n");
+    err.write("  --max-tokens N   limit the number of tokens of a line\n");
+    err.write("  --max-nodes N    limit the number of syntax tree nodes of a line\n");
+    err.write("  --max-depth N    limit the nesting depth of a line (default 10000, 0 unlimited)\n");
+    err.write("  --max-steps N    limit the number of evaluation steps of a line\n");
+    err.write("  --timeout-us N   limit the time spent on a line in microseconds\n");
+    err.write("  -e EXPR          evaluate EXPR instead of reading lines from stdin\n");
+    err.write("  --shm NAME       serve clients through the shared memory segment NAME (like /gpc)\n");
+    err.write("  --binary         answer binary request frames from stdin (see binary.hpp)\n");
+    err.write("  --pipeline       read, parse, evaluate and write stdin lines on a thread each\n");
+    err.write("  --trace FILE     write a Chrome/Perfetto trace of every line to FILE\n");
+    err.write("  --workers N      evaluate stdin in N worker processes\n");
+    err.write("  --worker-lines N replace a worker process after N lines (default 1000000, 0 never)\n");
+    err.write("lines exceeding a limit print LIMIT instead of ERROR\n");
+}
+
+/**
+ * Answer every line read from in_fd on out_fd, up to the first empty line.
+ */
+static void answer_lines(int in_fd, int out_fd, const evaluation_options& options, const print_options& print_options, bool pipelined) {
+    if (pipelined) {
+        pipeline_serve(in_fd, out_fd, options, print_result, &print_options);
+        return;
+    }
+
+    line_reader in(in_fd);
+    output_buffer out(out_fd);
     std::string line;
-    while(std::cin) {
-        std::getline(std::cin, line);
-        
-        if (line.length() == 0) {
+    outcome result;
+
+    for (uint64_t line_number = 1; ; line_number++) {
+        if (!in.buffered()) {
+            // answer everything so far before waiting for more input
+            out.flush();
+        }
+
+        if (!in.next(line, options.limits.max_bytes) || line.length() == 0) {
             break;
         }
-        
-        try {
-            parser parser(tokenizer(line).tokens());
-            std::cout << parser.ast()->eval() << "\n";
-        } catch(const char* exception) {
-            error(exception);
-        } catch(const std::string& exception) {
-            error(exception);
+
+        evaluate(line, options, result, line_number);
+        print(out, result, print_options);
+    }
+}
+
+/**
+ * Everything a worker process of the coordinator needs.
+ */
+struct worker_context {
+    const evaluation_options* options;
+    const print_options* printing;
+    bool pipelined;
+};
+
+static void run_worker(int in_fd, int out_fd, void* context) {
+    worker_context* worker = static_cast<worker_context*>(context);
+    answer_lines(in_fd, out_fd, *worker->options, *worker->printing, worker->pipelined);
+}
+
+/**
+ * Evaluate the expressions, serve the shared memory segment, answer binary frames, coordinate worker processes
+ * or read lines from stdin.
+ */
+static int run(const evaluation_options& options, const print_options& print_options, const std::vector<const char*>& expressions, const char* shm_name, bool binary, bool pipelined, const coordinator_options* coordinator_options) {
+    if (shm_name) {
+        return serve_shm(shm_name, options);
+    }
+
+    if (!expressions.empty()) {
+        output_buffer out(STDOUT_FILENO);
+        std::string line;
+        outcome result;
+
+        for (std::vector<const char*>::const_iterator it = expressions.begin(); it != expressions.end(); it++) {
+            line = *it;
+            evaluate(line, options, result, it - expressions.begin() + 1);
+            print(out, result, print_options);
         }
-    };
+        return EXIT_SUCCESS;
+    }
+
+    if (binary) {
+        binary_serve(STDIN_FILENO, STDOUT_FILENO, options);
+        return EXIT_SUCCESS;
+    }
+
+    if (coordinator_options) {
+        worker_context context = { &options, &print_options, pipelined };
+        return coordinate(STDIN_FILENO, STDOUT_FILENO, *coordinator_options, run_worker, &context);
+    }
+
+    answer_lines(STDIN_FILENO, STDOUT_FILENO, options, print_options, pipelined);
 
     return EXIT_SUCCESS;
 }
 
+int main (int argc, const char* argv[]) {
+    evaluation_options options;
+    print_options print_options;
+    std::vector<const char*> expressions;
+    const char* shm_name = 0;
+    const char* trace_path = 0;
+    coordinator_options coordinator_options;
+    bool coordinated = false;
+    bool binary = false;
+    bool pipelined = false;
+
+    for (int i = 1; i < argc; i++) {
+        // whether the argument of the option (if any) is valid
+        bool valid = true;
+
+        if (std::strcmp(argv[i], "--dag") == 0) {
+            options.share_nodes = true;
+        } else if (std::strcmp(argv[i], "--words") == 0) {
+            print_options.words = true;
+        } else if (std::strcmp(argv[i], "--precision") == 0 && i + 1 < argc) {
+            valid = parse_count(argv[++i], print_options.precision)
+                && print_options.precision >= 1 && print_options.precision <= 17;
+        } else if (std::strcmp(argv[i], "--max-bytes") == 0 && i + 1 < argc) {
+            valid = parse_count(argv[++i], options.limits.max_bytes);
+        } else if (std::strcmp(argv[i], "--max-tokens") == 0 && i + 1 < argc) {
+            valid = parse_count(argv[++i], options.limits.max_tokens);
+        } else if (std::strcmp(argv[i], "--max-nodes") == 0 && i + 1 < argc) {
+            valid = parse_count(argv[++i], options.limits.max_nodes);
+        } else if (std::strcmp(argv[i], "--max-depth") == 0 && i + 1 < argc) {
+            valid = parse_count(argv[++i], options.limits.max_depth);
+        } else if (std::strcmp(argv[i], "--max-steps") == 0 && i + 1 < argc) {
+            valid = parse_count(argv[++i], options.limits.max_steps);
+        } else if (std::strcmp(argv[i], "--timeout-us") == 0 && i + 1 < argc) {
+            valid = parse_count(argv[++i], options.limits.max_time_us);
+        } else if (std::strcmp(argv[i], "-e") == 0 && i + 1 < argc) {
+            expressions.push_back(argv[++i]);
+        } else if (std::strcmp(argv[i], "--shm") == 0 && i + 1 < argc) {
+            shm_name = argv[++i];
+        } else if (std::strcmp(argv[i], "--binary") == 0) {
+            binary = true;
+        } else if (std::strcmp(argv[i], "--pipeline") == 0) {
+            pipelined = true;
+        } else if (std::strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            trace_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+            valid = parse_count(argv[++i], coordinator_options.workers) && coordinator_options.workers >= 1;
+            coordinated = true;
+        } else if (std::strcmp(argv[i], "--worker-lines") == 0 && i + 1 < argc) {
+            valid = parse_count(argv[++i], coordinator_options.worker_lines);
+        } else {
+            valid = false;
+        }
+
+        if (!valid) {
+            usage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    coordinator_options.max_bytes = options.limits.max_bytes;
+
+    if (trace_path && coordinated) {
+        // the tracing thread does not survive the fork into the workers
+        return conflict("--trace", "--workers");
+    } else if (coordinated && (shm_name || !expressions.empty())) {
+        // the workers only answer lines from stdin
+        return conflict("--workers", shm_name ? "--shm" : "-e");
+    } else if (shm_name && !expressions.empty()) {
+        return conflict("-e", "--shm");
+    } else if (binary && (coordinated || shm_name || !expressions.empty())) {
+        return conflict("--binary", coordinated ? "--workers" : shm_name ? "--shm" : "-e");
+    } else if (pipelined && (binary || shm_name || !expressions.empty())) {
+        // only lines from stdin go through the pipeline
+        return conflict("--pipeline", binary ? "--binary" : shm_name ? "--shm" : "-e");
+    }
+
+    if (trace_path && !trace_start(trace_path)) {
+        output_buffer err(STDERR_FILENO);
+        err.write("gpc: Can not create trace file '");
+        err.write(trace_path);
+        err.write("'\n");
+        return EXIT_FAILURE;
+    }
+
+    int status = run(options, print_options, expressions, shm_name, binary, pipelined, coordinated ? &coordinator_options : 0);
+    trace_stop();
+
+    return status;
+}
@@ -1,186 +1,428 @@
-#include <iostream>
-#include <sstream>
+#include <limits>
+#include <utility>
 #include "parser.hpp"
 
 using namespace gpc;
 
-parser::parser(token_vector_t& tokens) : m_tokens(tokens), m_current_token(m_tokens.begin()), m_root(parse_expression())  {    
+/**
+ * Classes of words in a lexical number.
+ *
+ * Doubles as the state of the lexical number decoder, the state being the class
+ * of the last word read.
+ */
+enum lexical_class {
+    LEXICAL_START,
+    LEXICAL_ONNER,
+    LEXICAL_TEEN,
+    LEXICAL_TENNER,
+    LEXICAL_HUNDRED,
+    LEXICAL_SCALE,
+    LEXICAL_AND,
+    LEXICAL_NONE
+};
+
+/**
+ * Largest lexical number, the largest magnitude of numbers in the syntax tree (2^53 - 1).
+ */
+static const long long max_lexical_number = 9007199254740991LL;
+
+/**
+ * Which class of word may follow which, indexed by [last][next].
+ */
+static const bool lexical_transitions[LEXICAL_NONE][LEXICAL_NONE] = {
+    //            start  onner  teen   tenner hundred scale  and
+    /* start   */ {false, true,  true,  true,  false,  false, false},
+    /* onner   */ {false, false, false, false, true,   true,  false},
+    /* teen    */ {false, false, false, false, true,   true,  false},
+    /* tenner  */ {false, true,  false, false, true,   true,  false},
+    /* hundred */ {false, true,  true,  true,  false,  true,  true },
+    /* scale   */ {false, true,  true,  true,  false,  false, true },
+    /* and     */ {false, true,  true,  true,  false,  false, false}
+};
+
+/**
+ * Returns the class of a token.
+ */
+static enum lexical_class lexical_class_of(const token& token, long long value) {
+    switch (token.type) {
+        case TOKEN_LEXICAL_ONNER:
+            return LEXICAL_ONNER;
+        case TOKEN_LEXICAL_TEENS:
+            return LEXICAL_TEEN;
+        case TOKEN_LEXICAL_TENNER:
+            return LEXICAL_TENNER;
+        case TOKEN_LEXICAL_MULTIPLIER:
+            return (value == 100) ? LEXICAL_HUNDRED : LEXICAL_SCALE;
+        case TOKEN_LEXICAL_AND:
+            return LEXICAL_AND;
+        default:
+            return LEXICAL_NONE;
+    }
+}
+
+/**
+ * Owns a partly built subtree while the parser goes on.
+ *
+ * Releases the subtree if parsing fails before it is taken over by its parent.
+ */
+class subtree {
+public:
+    subtree(node* node) : m_node(node) {}
+
+    ~subtree() {
+        if (m_node) {
+            m_node->release();
+        }
+    }
+
+    /**
+     * Hand the subtree over to the caller.
+     */
+    node* take() {
+        node* result = m_node;
+        m_node = 0;
+        return result;
+    }
+
+    void reset(node* node) {
+        m_node = node;
+    }
+
+private:
+    node* m_node;
+};
+
+node_key::node_key(enum token_type kind, long long value, node* left, node* right)
+    : kind(kind), value(value), left(left), right(right) {}
+
+bool node_key::operator==(const node_key& other) const {
+    return kind == other.kind && value == other.value && left == other.left && right == other.right;
+}
+
+/**
+ * Mixes the fields into one word and spreads it over all bits (the finalizer of MurmurHash3).
+ */
+static uint64_t hash_key(const node_key& key) {
+    uint64_t hash = static_cast<uint64_t>(key.value);
+    hash = hash * 31 + static_cast<uint64_t>(key.kind);
+    hash = hash * 31 + reinterpret_cast<uintptr_t>(key.left);
+    hash = hash * 31 + reinterpret_cast<uintptr_t>(key.right);
+
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+
+    return hash;
+}
+
+node_table::node_table(size_t capacity)
+    : m_slots(m_inline), m_miss_index(0), m_miss_hash(0) {
+    // at most half full, so probe sequences stay short
+    size_t size = inline_slots;
+    while (size < capacity * 2) {
+        size *= 2;
+    }
+    if (size > inline_slots) {
+        m_allocated.reset(new slot[size]);
+        m_slots = m_allocated.get();
+    }
+    for (size_t i = 0; i < size; i++) {
+        m_slots[i].node = 0;
+    }
+    m_mask = size - 1;
+    m_nodes.reserve(capacity);
+}
+
+node* node_table::find(const node_key& key) {
+    uint64_t hash = hash_key(key);
+    size_t index = static_cast<size_t>(hash) & m_mask;
+    // the index takes the low bits, compare the high ones
+    uint32_t check = static_cast<uint32_t>(hash >> 32);
+
+    // linear probing, an empty slot ends the search and is where a new node goes
+    for (; m_slots[index].node; index = (index + 1) & m_mask) {
+        if (m_slots[index].hash == check) {
+            const entry& candidate = m_nodes[m_slots[index].node - 1];
+            if (candidate.key == key) {
+                return candidate.node;
+            }
+        }
+    }
+
+    m_miss_index = index;
+    m_miss_hash = check;
+    m_miss_key = key;
+    return 0;
+}
+
+void node_table::add(node* node) {
+    m_nodes.push_back(entry { m_miss_key, node });
+    m_slots[m_miss_index].hash = m_miss_hash;
+    m_slots[m_miss_index].node = static_cast<uint32_t>(m_nodes.size());
+}
+
+parser::parser(token_vector_t&& tokens, bool share_nodes, budget* budget, size_t* error_position) : m_tokens(std::move(tokens)), m_current_token(m_tokens.begin()), m_share_nodes(share_nodes), m_node_table(share_nodes ? m_tokens.size() : 0), m_budget(budget), m_nesting(0), m_error_position(error_position), m_root(parse_expression())  {    
     if (m_current_token != m_tokens.end()) {
+        mark_error();
+        // the destructor does not run for a throwing constructor
+        m_root->release();
         throw "Expected EOL|+|- but got '" + m_current_token->value + "'";
     }
 }
 
 parser::~parser() {
-    delete m_root;
+    m_root->release();
 }
 
 node* parser::ast() {
     return m_root;
 }
 
+node* parser::make_number(long long value) {
+    node_key key(TOKEN_DIGIT, value, 0, 0);
+    node* result = find_shared(key);
+
+    return result ? result : remember(new number_node(value));
+}
+
+node* parser::make_unary_minus(node* child) {
+    node_key key(TOKEN_MINUS, 0, child, 0);
+    node* result = find_shared(key);
+
+    return result ? result : remember(new unary_minus_node(child));
+}
+
+node* parser::make_operation(enum token_type type, node* left, node* right) {
+    node_key key(type, 0, left, right);
+    node* result = find_shared(key);
+
+    if (result) {
+        return result;
+    }
+
+    switch (type) {
+        case TOKEN_PLUS:
+            result = new add_op_node(left, right);
+            break;
+        case TOKEN_MINUS:
+            result = new sub_op_node(left, right);
+            break;
+        case TOKEN_MULTIPLY:
+            result = new mul_op_node(left, right);
+            break;
+        default:
+            result = new div_op_node(left, right);
+            break;
+    }
+
+    return remember(result);
+}
+
+node* parser::find_shared(const node_key& key) {
+    if (!m_share_nodes) {
+        return 0;
+    }
+
+    // a miss leaves its slot to remember(), so a new node costs a single lookup
+    node* shared = m_node_table.find(key);
+    if (!shared) {
+        return 0;
+    }
+
+    // the existing node already holds its own references to the children
+    if (key.left) {
+        key.left->release();
+    }
+    if (key.right) {
+        key.right->release();
+    }
+    shared->retain();
+
+    return shared;
+}
+
+node* parser::remember(node* result) {
+    if (m_budget) {
+        try {
+            m_budget->charge_node();
+            m_budget->check_depth(result->depth());
+        } catch (const limit_exceeded&) {
+            // not added to the table
+            result->release();
+            throw;
+        }
+    }
+
+    if (m_share_nodes) {
+        m_node_table.add(result);
+    }
+
+    return result;
+}
+
+void parser::mark_error() {
+    if (m_error_position) {
+        *m_error_position = m_current_token - m_tokens.begin();
+    }
+}
+
 node* parser::parse_expression() {
-    node* result = parse_term();
+    subtree result(parse_term());
 
     while (m_current_token != m_tokens.end()) {
         if (m_current_token->type == TOKEN_PLUS) {
             m_current_token++;
-            result = new add_op_node(result, parse_term());
+            node* right = parse_term();
+            result.reset(make_operation(TOKEN_PLUS, result.take(), right));
         } else if (m_current_token->type == TOKEN_MINUS)  {
             m_current_token++;
-            result = new sub_op_node(result, parse_term());
+            node* right = parse_term();
+            result.reset(make_operation(TOKEN_MINUS, result.take(), right));
         } else {
-            return result;
+            return result.take();
         }
     }
 
-    return result;
+    return result.take();
 }
 
 node* parser::parse_term() {
-    node* result = parse_factor();
+    subtree result(parse_factor());
 
     while (m_current_token != m_tokens.end()) {
         if (m_current_token->type == TOKEN_MULTIPLY) {
             m_current_token++;
-            result = new mul_op_node(result, parse_factor());
+            node* right = parse_factor();
+            result.reset(make_operation(TOKEN_MULTIPLY, result.take(), right));
         } else if (m_current_token->type == TOKEN_DIVIDE) {
             m_current_token++;
-            result = new div_op_node(result, parse_factor());
+            node* right = parse_factor();
+            result.reset(make_operation(TOKEN_DIVIDE, result.take(), right));
         } else {
-            return result;
+            return result.take();
         }
     }
 
-    return result;
+    return result.take();
 }
 
 node* parser::parse_factor() {
     if (m_current_token == m_tokens.end()) {
+        mark_error();
         throw "Expected a number but got EOL";
     }
 
     if (m_current_token->type == TOKEN_MINUS) {
         m_current_token++;
-        return new unary_minus_node(parse_factor());
+        if (m_budget) {
+            m_budget->check_depth(++m_nesting);
+        }
+        node* result = make_unary_minus(parse_factor());
+        m_nesting--;
+        return result;
+    } else if (m_current_token->type == TOKEN_NUMBER) {
+        return make_number(parse_number());
     } else if (m_current_token->type == TOKEN_DIGIT) {
-        return new number_node(parse_digit_number());
+        return make_number(parse_digit_number());
     } else {
-        return new number_node(parse_lexical_number());
+        return make_number(parse_lexical_number());
     }
 }
 
-int parser::parse_digit_number() {    
-    int result;
-    std::stringstream ss(m_current_token->value);
-    ss >> result;
+long long parser::parse_number() {
+    long long result = m_current_token->number;
     m_current_token++;
 
     return result;
 }
 
-int parser::parse_lexical_number() {
-    int result = parse_lexical_onner_or_teenie_or_tenner();
-
-    while (m_current_token != m_tokens.end() && m_current_token->type == TOKEN_LEXICAL_MULTIPLIER) {
-        result *= number_table[m_current_token->value];
-        m_current_token++;
-    }
+long long parser::parse_digit_number() {
+    const std::string& digits = m_current_token->value;
+    long long result = 0;
 
-    if ((m_current_token->type == TOKEN_LEXICAL_AND) || (m_current_token->type == TOKEN_LEXICAL_ONNER) || (m_current_token->type == TOKEN_LEXICAL_TEENS) || (m_current_token->type == TOKEN_LEXICAL_TENNER)) {
-        if (m_current_token->type == TOKEN_LEXICAL_AND) {
-            m_current_token++; // skip the 'and'
+    for (std::string::const_iterator it = digits.begin(); it != digits.end(); it++) {
+        int digit = *it - '0';
+        if (result > (std::numeric_limits<long long>::max() - digit) / 10) {
+            mark_error();
+            throw "Number to big.";
         }
-        result += parse_lexical_number();
+        result = result * 10 + digit;
     }
+    m_current_token++;
 
     return result;
 }
 
-int parser::parse_lexical_onner_or_teenie_or_tenner() {
-    int result;
+/**
+ * Decodes the number in one pass from left to right.
+ *
+ * 'group' collects the words below the last scale (like 'three hundred and five'),
+ * a scale word moves the group multiplied by the scale into 'total'. Scales must
+ * get smaller from left to right and a group is below 10^4 (like 'ninety nine
+ * hundred'), which keeps the result below 10^17, so there is no way to overflow
+ * 64 bits here. The value only grows word by word, so the word which takes it
+ * beyond max_lexical_number is the one marked as error.
+ */
+long long parser::parse_lexical_number() {
+    enum lexical_class state = LEXICAL_START;
+    long long total = 0;
+    long long group = 0;
+    long long last_scale = 0;
 
-    if (!parse_lexical_onner_or_teenie(result)) {
-        if (!parse_lexical_tenner(result)) {
-            throw "Expected lexical number";
+    while (m_current_token != m_tokens.end()) {
+        long long value = m_current_token->number;
+        enum lexical_class next = lexical_class_of(*m_current_token, value);
+
+        if (next == LEXICAL_NONE || !lexical_transitions[state][next]) {
+            break;
         }
-    }
 
-    return result;
-}
+        if (next == LEXICAL_ONNER && value == 0) {
+            if (state == LEXICAL_TENNER) {
+                mark_error();
+                throw "Expected one|two|three|... but got zero.";
+            } else if (state == LEXICAL_START) {
+                m_current_token++;
+                return 0;
+            }
+            break;
+        } else if (next == LEXICAL_HUNDRED && group >= 100) {
+            break;
+        } else if (next == LEXICAL_SCALE && last_scale != 0 && value >= last_scale) {
+            break;
+        }
 
-bool parser::parse_lexical_onner_or_teenie(int& result) {
-    if (m_current_token != m_tokens.end() && (m_current_token->type == TOKEN_LEXICAL_ONNER || m_current_token->type == TOKEN_LEXICAL_TEENS)) {
-        result = number_table[m_current_token->value];
-        m_current_token++;
-        return true;
-    }
+        switch (next) {
+            case LEXICAL_HUNDRED:
+                group *= value;
+                break;
+            case LEXICAL_SCALE:
+                total += group * value;
+                group = 0;
+                last_scale = value;
+                break;
+            case LEXICAL_AND:
+                break;
+            default:
+                group += value;
+                break;
+        }
 
-    return false;
-}
+        if (total + group > max_lexical_number) {
+            mark_error();
+            throw "Number to big.";
+        }
 
-bool parser::parse_lexical_tenner(int& result) {
-    if (m_current_token != m_tokens.end() && m_current_token->type == TOKEN_LEXICAL_TENNER) {
-        result = number_table[m_current_token->value];
+        state = next;
         m_current_token++;
-        if (m_current_token != m_tokens.end() && m_current_token->type == TOKEN_LEXICAL_ONNER) {
-            int onner = number_table[m_current_token->value];
-            m_current_token++;
-            if (onner == 0) {
-                throw "Expected one|two|three|... but got zero.";
-            }
-            result += onner;
-        }
-        return true;
     }
 
-    return false;
-}
-
-/**
- * Fill the number table with values.
- */
-static number_table_t create_number_table()
-{
-    number_table_t result;
-
-    result.insert(std::make_pair("zero", 0));
-    result.insert(std::make_pair("one", 1));
-    result.insert(std::make_pair("two", 2));
-    result.insert(std::make_pair("three", 3));
-    result.insert(std::make_pair("four", 4));
-    result.insert(std::make_pair("five", 5));
-    result.insert(std::make_pair("six", 6));
-    result.insert(std::make_pair("seven", 7));
-    result.insert(std::make_pair("eight", 8));
-    result.insert(std::make_pair("nine", 9));
-
-    result.insert(std::make_pair("ten", 10));
-    result.insert(std::make_pair("eleven", 11));
-    result.insert(std::make_pair("twelve", 12));
-    result.insert(std::make_pair("thirteen", 13));
-    result.insert(std::make_pair("fourteen", 14));
-    result.insert(std::make_pair("fifteen", 15));
-    result.insert(std::make_pair("sixteen", 16));
-    result.insert(std::make_pair("seventeen", 17));
-    result.insert(std::make_pair("eighteen", 18));
-    result.insert(std::make_pair("nineteen", 19));
-
-    result.insert(std::make_pair("twenty", 20));
-    result.insert(std::make_pair("thirty", 30));
-    result.insert(std::make_pair("forty", 40));
-    result.insert(std::make_pair("fifty", 50));
-    result.insert(std::make_pair("sixty", 60));
-    result.insert(std::make_pair("seventy", 70));
-    result.insert(std::make_pair("eighty", 80));
-    result.insert(std::make_pair("ninety", 90));
-
-    result.insert(std::make_pair("hundred", 100));
-    result.insert(std::make_pair("thousand", 1000));
-    result.insert(std::make_pair("million", 1000000));
-
-    result.insert(std::make_pair("and", TOKEN_LEXICAL_AND));
+    if (state == LEXICAL_START || state == LEXICAL_AND) {
+        mark_error();
+        throw "Expected lexical number";
+    }
 
-    return result;
+    return total + group;
 }
-
-number_table_t parser::number_table = create_number_table();
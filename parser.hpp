@@ -9,20 +9,92 @@
 #ifndef __GPC_PARSER_HPP_INCLUDED__
 #define __GPC_PARSER_HPP_INCLUDED__
 
+#include <memory>
+#include <stdint.h>
+#include <vector>
 #include "tokenizer.hpp"
 #include "ast.hpp"
 
 namespace gpc {
 
     /**
-     * Convient typedef for easier access to the number table map type.
+     * Structural identity of a syntax tree node.
+     *
+     * The kind is the token the node was built from, children are compared by
+     * identity because they are already unique when hash-consing.
      */
-    typedef std::map<std::string, int> number_table_t;
+    struct node_key {
+        /**
+         * Leaves the fields uninitialized, for a node_table before its first miss.
+         */
+        node_key() {}
+        node_key(enum token_type kind, long long value, node* left, node* right);
+        bool operator==(const node_key& other) const;
+        enum token_type kind;
+        long long value;
+        node* left;
+        node* right;
+    };
 
     /**
-     * Convient typedef for easier access to the number table map iterator type.
+     * Hash-consing table, an open addressing hash table of nodes by their node_key.
+     *
+     * Every token turns into one node at most, so the table is sized once for the
+     * number of tokens and never grows. The probed slots only hold part of the hash
+     * and the index of the node, the keys and nodes are appended in the order they
+     * are built. So a lookup touches little memory, and the table of a short line
+     * fits into the object itself.
      */
-    typedef number_table_t::const_iterator number_iterator_t;
+    class node_table {
+    public:
+
+        /**
+         * An empty table for up to 'capacity' nodes.
+         */
+        node_table(size_t capacity);
+
+        /**
+         * Return the node with the structure of the key or 0.
+         */
+        node* find(const node_key& key);
+
+        /**
+         * Add a new node with the key of the last find(), which must have missed.
+         */
+        void add(node* node);
+
+    private:
+        struct slot {
+            uint32_t hash;
+
+            /**
+             * Index into m_nodes plus one, 0 for an empty slot.
+             */
+            uint32_t node;
+        };
+
+        struct entry {
+            node_key key;
+            gpc::node* node;
+        };
+
+        /**
+         * Number of slots kept in the object itself (a power of two).
+         */
+        static const size_t inline_slots = 32;
+        slot m_inline[inline_slots];
+        std::unique_ptr<slot[]> m_allocated;
+        slot* m_slots;
+        size_t m_mask;
+        std::vector<entry> m_nodes;
+
+        /**
+         * Where the last find() missed.
+         */
+        size_t m_miss_index;
+        uint32_t m_miss_hash;
+        node_key m_miss_key;
+    };
 
     /**
      * Transforms a list of token to a syntax tree which can be evaluated to calculate the result.
@@ -32,8 +104,14 @@ namespace gpc {
 
         /**
          * Construct a new parser by parsing the given tokens.
+         *
+         * If share_nodes is set structurally identical subtrees are built only once
+         * and shared, which turns the syntax tree into a DAG. Every new node and the
+         * depth of the tree are checked against the budget (if any). On a syntax error
+         * the index of the offending token is stored in error_position (if any).
+         * The tokens are moved into the parser, not copied.
          */
-        parser(token_vector_t& tokens);
+        parser(token_vector_t&& tokens, bool share_nodes = false, budget* budget = 0, size_t* error_position = 0);
 
         /**
          * Cleanup.
@@ -47,11 +125,6 @@ namespace gpc {
         
     private:
 
-        /**
-         * Map of lexical numbers to thier integer value
-         */
-        static number_table_t number_table;
-
         /**
          * List of tokens to analyize.
          */
@@ -62,50 +135,102 @@ namespace gpc {
          */
         token_iterator_t m_current_token;
 
+        /**
+         * Whether identical subtrees are shared.
+         */
+        bool m_share_nodes;
+
+        /**
+         * Already built nodes by their structure, only used when sharing nodes.
+         */
+        node_table m_node_table;
+
+        /**
+         * Budget to charge, may be 0.
+         */
+        budget* m_budget;
+
+        /**
+         * Current depth of recursion through unary minus.
+         */
+        size_t m_nesting;
+
+        /**
+         * Where to store the token index of a syntax error, may be 0.
+         */
+        size_t* m_error_position;
+
         /**
          * Root node of the syntax tree.
          */
         node* m_root;
 
         /**
-         * Grammer: Parse a calculator expression.
+         * Create (or reuse) a number leaf.
          */
-        node* parse_expression();
+        node* make_number(long long value);
 
         /**
-         * Grammer: Parse a term (+|-).
+         * Create (or reuse) a node which negates the given child.
          */
-        node* parse_term();
+        node* make_unary_minus(node* child);
 
         /**
-         * Grammer: Parse a factor (*|/)
+         * Create (or reuse) an operation node for the given operation token type.
+         *
+         * Takes over the references to the children, also when it throws.
          */
-        node* parse_factor();
+        node* make_operation(enum token_type type, node* left, node* right);
 
         /**
-         * Grammer: Parse a digital number (0123456789).
+         * Return an already built node with the given structure or 0.
+         *
+         * On a hit the references to the children of the key are handed over to
+         * the existing node.
+         */
+        node* find_shared(const node_key& key);
+
+        /**
+         * Charge a freshly built node and remember it for later sharing.
+         *
+         * The node has the key of the last find_shared(), which missed.
          */
-        int parse_digit_number();
+        node* remember(node* result);
 
         /**
-         * Grammer: Parse a lexical number (one hundred and seven).
+         * Store the index of the current token as error position, call before throwing.
          */
-        int parse_lexical_number();
+        void mark_error();
 
         /**
-         * Grammer: Parse a lexical numeric without multipliers like 'hundred'.
+         * Grammer: Parse a calculator expression.
          */
-        int parse_lexical_onner_or_teenie_or_tenner();
+        node* parse_expression();
 
         /**
-         * Grammer: Parse a lexical numeric (1-19).
+         * Grammer: Parse a term (+|-).
+         */
+        node* parse_term();
+
+        /**
+         * Grammer: Parse a factor (*|/)
+         */
+        node* parse_factor();
+
+        /**
+         * Grammar: Parse an already converted number.
+         */
+        long long parse_number();
+
+        /**
+         * Grammer: Parse a digital number (0123456789).
          */
-        bool parse_lexical_onner_or_teenie(int& result);
+        long long parse_digit_number();
 
         /**
-         * Grammer: Parse a lexical numeric (20-99).
+         * Grammar: Parse a lexical number (two million three hundred thousand and five).
          */
-        bool parse_lexical_tenner(int& result);
+        long long parse_lexical_number();
 
     };
 
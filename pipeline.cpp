@@ -0,0 +1,122 @@
+#include <deque>
+#include <functional>
+#include <string>
+#include <thread>
+#include "pipeline.hpp"
+#include "spsc_queue.hpp"
+
+using namespace gpc;
+
+/**
+ * Number of lines in the pipeline at most, and the size of each queue.
+ */
+static const uint32_t pipeline_jobs = 1024;
+
+/**
+ * A line and everything which belongs to it on its way through the stages.
+ *
+ * Only one stage at a time owns a job, so nothing in it needs synchronization.
+ */
+struct pipeline_job {
+    pipeline_job(const evaluation_options& options) : id(0), evaluation(options), parsed(false) {}
+    std::string line;
+    uint64_t id;
+    staged_evaluation evaluation;
+    bool parsed;
+    outcome result;
+};
+
+/**
+ * Queue of jobs between two stages, a null job marks the end of the input.
+ */
+typedef spsc_queue<pipeline_job*, pipeline_jobs> job_queue;
+
+/**
+ * The queues of the stages.
+ *
+ * There are only pipeline_jobs jobs which circle from 'idle' through the stages
+ * back to 'idle', so a queue never gets full. The reader takes an idle job
+ * before it sends the end of the input, which leaves room for the null job.
+ */
+struct pipeline {
+    job_queue idle;
+    job_queue read;
+    job_queue parsed;
+    job_queue evaluated;
+};
+
+static void parse_stage(pipeline& pipeline) {
+    for (;;) {
+        pipeline_job* job = pipeline.read.pop();
+        if (!job) {
+            pipeline.parsed.push(0);
+            return;
+        }
+
+        job->parsed = job->evaluation.parse(job->line, job->result, job->id);
+        pipeline.parsed.push(job);
+    }
+}
+
+static void eval_stage(pipeline& pipeline) {
+    for (;;) {
+        pipeline_job* job = pipeline.parsed.pop();
+        if (!job) {
+            pipeline.evaluated.push(0);
+            return;
+        }
+
+        if (job->parsed) {
+            job->evaluation.eval(job->result);
+        }
+        pipeline.evaluated.push(job);
+    }
+}
+
+static void print_stage(pipeline& pipeline, int out_fd, print_function print, const void* context) {
+    output_buffer out(out_fd);
+
+    for (;;) {
+        pipeline_job* job = pipeline.evaluated.pop();
+        if (!job) {
+            return;
+        }
+
+        print(out, job->result, context);
+        pipeline.idle.push(job);
+
+        if (pipeline.evaluated.empty()) {
+            // nothing else is ready, do not keep the answers waiting
+            out.flush();
+        }
+    }
+}
+
+void gpc::pipeline_serve(int in_fd, int out_fd, const evaluation_options& options, print_function print, const void* context) {
+    pipeline* stages = new pipeline();
+    std::deque<pipeline_job> jobs;
+    for (uint32_t i = 0; i < pipeline_jobs; i++) {
+        jobs.emplace_back(options);
+        stages->idle.push(&jobs.back());
+    }
+
+    std::thread parser(parse_stage, std::ref(*stages));
+    std::thread evaluator(eval_stage, std::ref(*stages));
+    std::thread printer(print_stage, std::ref(*stages), out_fd, print, context);
+
+    line_reader in(in_fd);
+    for (uint64_t line_number = 1; ; line_number++) {
+        pipeline_job* job = stages->idle.pop();
+        if (!in.next(job->line, options.limits.max_bytes) || job->line.length() == 0) {
+            break;
+        }
+        job->id = line_number;
+        stages->read.push(job);
+    }
+    stages->read.push(0);
+
+    parser.join();
+    evaluator.join();
+    printer.join();
+    delete stages;
+}
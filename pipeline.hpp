@@ -0,0 +1,27 @@
+#ifndef __GPC_PIPELINE_HPP_INCLUDED__
+#define __GPC_PIPELINE_HPP_INCLUDED__
+
+#include "evaluation.hpp"
+#include "io.hpp"
+
+namespace gpc {
+
+    /**
+     * Writes the answer of a line to the output.
+     */
+    typedef void (*print_function)(output_buffer& out, const outcome& result, const void* context);
+
+    /**
+     * Answer the lines of in_fd (up to the first empty line) on out_fd with a
+     * thread for each stage: reading, tokenizing and parsing, evaluating, and
+     * printing and writing.
+     *
+     * The stages are connected by lock-free queues through which the lines are
+     * handed over with their syntax trees. The output is written as soon as the
+     * printing stage has nothing left to do.
+     */
+    void pipeline_serve(int in_fd, int out_fd, const evaluation_options& options, print_function print, const void* context);
+
+}
+
+#endif //__GPC_PIPELINE_HPP_INCLUDED__
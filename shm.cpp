@@ -0,0 +1,82 @@
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <cerrno>
+#include <new>
+#include "futex.hpp"
+#include "shm.hpp"
+
+using namespace gpc;
+
+shm_response_ring::shm_response_ring()
+    : owner(0), generation(0), waiting(0), dropped(0), head(0), tail(0) {}
+
+shm_segment::shm_segment()
+    : magic(0), server_waiting(0), request_signal(0), request_tail(0), request_head(0) {
+    for (uint32_t i = 0; i < shm_request_slots; i++) {
+        requests[i].state.store(shm_slot_state(i, 0), std::memory_order_relaxed);
+    }
+}
+
+/**
+ * Open and map the named segment.
+ */
+static void* shm_map(const char* name, int flags) {
+    int fd = shm_open(name, flags, 0600);
+    if (fd < 0) {
+        throw "Can not open shared memory segment";
+    }
+
+    if ((flags & O_CREAT) && ftruncate(fd, sizeof(shm_segment)) != 0) {
+        close(fd);
+        shm_unlink(name);
+        throw "Can not size shared memory segment";
+    }
+
+    void* memory = mmap(0, sizeof(shm_segment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED) {
+        throw "Can not map shared memory segment";
+    }
+
+    return memory;
+}
+
+shm_segment* gpc::shm_create(const char* name) {
+    shm_segment* segment = new (shm_map(name, O_CREAT | O_EXCL | O_RDWR)) shm_segment();
+    segment->magic.store(shm_magic, std::memory_order_release);
+
+    return segment;
+}
+
+shm_segment* gpc::shm_attach(const char* name) {
+    shm_segment* segment = static_cast<shm_segment*>(shm_map(name, O_RDWR));
+    if (segment->magic.load(std::memory_order_acquire) != shm_magic) {
+        shm_detach(segment);
+        throw "Not a gpc shared memory segment";
+    }
+
+    return segment;
+}
+
+void gpc::shm_detach(shm_segment* segment) {
+    munmap(segment, sizeof(shm_segment));
+}
+
+void gpc::shm_remove(const char* name) {
+    shm_unlink(name);
+}
+
+bool gpc::shm_process_gone(uint32_t pid) {
+    return pid != 0 && kill(static_cast<pid_t>(pid), 0) != 0 && errno == ESRCH;
+}
+
+void gpc::shm_notify_server(shm_segment& segment) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (segment.server_waiting.load(std::memory_order_relaxed)) {
+        segment.request_signal.fetch_add(1, std::memory_order_release);
+        futex_wake(segment.request_signal);
+    }
+}
@@ -0,0 +1,189 @@
+#ifndef __GPC_SHM_HPP_INCLUDED__
+#define __GPC_SHM_HPP_INCLUDED__
+
+#include <atomic>
+#include <cstddef>
+#include <stdint.h>
+
+namespace gpc {
+
+    /**
+     * Written last when a segment is ready ("gpc5"), changes with the layout.
+     */
+    const uint32_t shm_magic = 0x35637067;
+
+    /**
+     * Number of slots of the request ring (a power of two).
+     */
+    const uint32_t shm_request_slots = 1024;
+
+    /**
+     * Number of slots of each response ring (a power of two).
+     *
+     * A client never has more requests in flight than this.
+     */
+    const uint32_t shm_response_slots = 256;
+
+    /**
+     * Number of clients which can be attached at the same time.
+     */
+    const uint32_t shm_clients = 32;
+
+    /**
+     * Longest expression which fits into a request.
+     */
+    const size_t shm_expression_size = 224;
+
+    /**
+     * Size of the (zero terminated) error message of a response.
+     */
+    const size_t shm_message_size = 48;
+
+    /**
+     * A request slot, written in place by a client.
+     *
+     * The state tells who owns the slot (see shm_segment).
+     */
+    struct shm_request {
+        /**
+         * The sequence in the low and the process id of the claimant in the high
+         * 32 bits, so a slot is claimed and its claimant recorded in one step.
+         */
+        std::atomic<uint64_t> state;
+        uint32_t client;
+        uint32_t length;
+
+        /**
+         * Generation of the response ring of the client, echoed in the response.
+         */
+        uint32_t generation;
+        uint32_t reserved;
+        uint64_t id;
+        char expression[shm_expression_size];
+    };
+
+    /**
+     * The state of a request slot.
+     */
+    inline uint64_t shm_slot_state(uint32_t sequence, uint32_t claimant) {
+        return static_cast<uint64_t>(claimant) << 32 | sequence;
+    }
+
+    inline uint32_t shm_slot_sequence(uint64_t state) {
+        return static_cast<uint32_t>(state);
+    }
+
+    inline uint32_t shm_slot_claimant(uint64_t state) {
+        return static_cast<uint32_t>(state >> 32);
+    }
+
+    /**
+     * A response slot, written by the server.
+     */
+    struct shm_response {
+        uint64_t id;
+
+        /**
+         * An outcome_kind.
+         */
+        uint32_t kind;
+
+        /**
+         * Generation of the request, see shm_response_ring.
+         */
+        uint32_t generation;
+        double value;
+        char message[shm_message_size];
+    };
+
+    /**
+     * Single producer (server) single consumer (client) ring of responses.
+     *
+     * A sleeping client sets 'waiting' and waits on 'tail' with a futex. The server
+     * never waits for a full ring, it drops the response and counts it in 'dropped'.
+     */
+    struct shm_response_ring {
+        shm_response_ring();
+
+        /**
+         * Process id of the client which uses the ring, 0 if the ring is free.
+         *
+         * The ring of a client which died without releasing it is taken over by
+         * the next client which finds that process gone.
+         */
+        std::atomic<uint32_t> owner;
+
+        /**
+         * Advanced whenever a client claims the ring.
+         *
+         * Requests of a dead owner may still be answered after the ring was taken
+         * over. Their responses carry the old generation and are skipped, request
+         * ids can not tell them apart since every client chooses its own.
+         */
+        std::atomic<uint32_t> generation;
+        std::atomic<uint32_t> waiting;
+        std::atomic<uint32_t> dropped;
+        alignas(64) std::atomic<uint32_t> head;
+        alignas(64) std::atomic<uint32_t> tail;
+        alignas(64) shm_response slots[shm_response_slots];
+    };
+
+    /**
+     * Layout of the shared memory segment.
+     *
+     * The request ring is a bounded multi producer single consumer queue: a slot at
+     * position p is free for a producer when its sequence is p and it has no claimant.
+     * The producer claims it by setting its own process id as claimant and then
+     * advances 'request_tail' (other producers help with that if it does not get to
+     * it). It publishes the slot by setting the sequence to p + 1, the server frees
+     * it again by setting the sequence to p + shm_request_slots.
+     * A producer which died between claiming and publishing would block the ring
+     * forever, so the server skips a slot which stays unpublished for a while once
+     * its claimant is gone. A live producer never loses its slot.
+     * A sleeping server sets 'server_waiting' and waits on 'request_signal' with a
+     * futex, so producers only make a syscall when the server actually sleeps.
+     */
+    struct shm_segment {
+        shm_segment();
+        std::atomic<uint32_t> magic;
+        std::atomic<uint32_t> server_waiting;
+        std::atomic<uint32_t> request_signal;
+        alignas(64) std::atomic<uint32_t> request_tail;
+        alignas(64) std::atomic<uint32_t> request_head;
+        alignas(64) shm_request requests[shm_request_slots];
+        shm_response_ring responses[shm_clients];
+    };
+
+    /**
+     * Create and map a new named segment.
+     */
+    shm_segment* shm_create(const char* name);
+
+    /**
+     * Map an existing named segment.
+     */
+    shm_segment* shm_attach(const char* name);
+
+    /**
+     * Unmap a segment.
+     */
+    void shm_detach(shm_segment* segment);
+
+    /**
+     * Remove the name of a segment, it disappears after the last process detached.
+     */
+    void shm_remove(const char* name);
+
+    /**
+     * Whether the process with the id (a ring owner or a claimant) is gone.
+     */
+    bool shm_process_gone(uint32_t pid);
+
+    /**
+     * Wake the server if it sleeps, called by clients after publishing a request.
+     */
+    void shm_notify_server(shm_segment& segment);
+
+}
+
+#endif //__GPC_SHM_HPP_INCLUDED__
@@ -0,0 +1,115 @@
+#include <unistd.h>
+#include <cstring>
+#include "futex.hpp"
+#include "shm_client.hpp"
+
+using namespace gpc;
+
+shm_client::shm_client(const char* name)
+    : m_segment(shm_attach(name)), m_pid(static_cast<uint32_t>(getpid())), m_client(0), m_generation(0), m_ring(0) {
+    // a free ring first, the rings of dead clients only when there is none
+    for (int reclaim = 0; reclaim < 2 && !m_ring; reclaim++) {
+        for (uint32_t i = 0; i < shm_clients; i++) {
+            std::atomic<uint32_t>& owner = m_segment->responses[i].owner;
+            uint32_t expected = reclaim ? owner.load(std::memory_order_relaxed) : 0;
+            if ((!reclaim || shm_process_gone(expected)) && owner.compare_exchange_strong(expected, m_pid)) {
+                m_client = i;
+                m_ring = &m_segment->responses[i];
+                break;
+            }
+        }
+    }
+
+    if (!m_ring) {
+        shm_detach(m_segment);
+        throw "No free client slot in shared memory segment";
+    }
+
+    // drop whatever a previous owner left unread, responses to its requests still
+    // in flight may show up later and are told apart by the generation
+    m_generation = m_ring->generation.fetch_add(1, std::memory_order_acq_rel) + 1;
+    m_ring->head.store(m_ring->tail.load(std::memory_order_acquire), std::memory_order_release);
+    m_ring->dropped.store(0, std::memory_order_relaxed);
+}
+
+shm_client::~shm_client() {
+    m_ring->owner.store(0, std::memory_order_release);
+    shm_detach(m_segment);
+}
+
+bool shm_client::submit(uint64_t id, const char* expression, size_t length) {
+    if (length > shm_expression_size) {
+        throw "Expression too long for shared memory request";
+    }
+
+    uint32_t tail = m_segment->request_tail.load(std::memory_order_relaxed);
+    shm_request* request;
+    for (;;) {
+        request = &m_segment->requests[tail % shm_request_slots];
+        uint64_t state = request->state.load(std::memory_order_acquire);
+        int32_t distance = static_cast<int32_t>(shm_slot_sequence(state) - tail);
+        if (distance == 0 && shm_slot_claimant(state) == 0) {
+            if (request->state.compare_exchange_weak(state, shm_slot_state(tail, m_pid), std::memory_order_acquire, std::memory_order_relaxed)) {
+                m_segment->request_tail.compare_exchange_strong(tail, tail + 1, std::memory_order_relaxed);
+                break;
+            }
+        } else if (distance == 0) {
+            // claimed by another producer which did not advance the tail yet, help it
+            if (m_segment->request_tail.compare_exchange_weak(tail, tail + 1, std::memory_order_relaxed)) {
+                tail++;
+            }
+        } else if (distance < 0) {
+            return false;
+        } else {
+            tail = m_segment->request_tail.load(std::memory_order_relaxed);
+        }
+    }
+
+    request->client = m_client;
+    request->generation = m_generation;
+    request->id = id;
+    request->length = static_cast<uint32_t>(length);
+    std::memcpy(request->expression, expression, length);
+    request->state.store(shm_slot_state(tail + 1, 0), std::memory_order_release);
+
+    shm_notify_server(*m_segment);
+
+    return true;
+}
+
+bool shm_client::poll(shm_response& response) {
+    uint32_t head = m_ring->head.load(std::memory_order_relaxed);
+    uint32_t tail = m_ring->tail.load(std::memory_order_acquire);
+
+    while (head != tail) {
+        response = m_ring->slots[head % shm_response_slots];
+        m_ring->head.store(++head, std::memory_order_release);
+        if (response.generation == m_generation) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void shm_client::wait(shm_response& response) {
+    for (unsigned int i = futex_spins(); i != 0; i--) {
+        if (poll(response)) {
+            return;
+        }
+    }
+
+    while (!poll(response)) {
+        uint32_t head = m_ring->head.load(std::memory_order_relaxed);
+        m_ring->waiting.store(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_ring->tail.load(std::memory_order_relaxed) == head) {
+            futex_wait(m_ring->tail, head);
+        }
+        m_ring->waiting.store(0, std::memory_order_relaxed);
+    }
+}
+
+uint32_t shm_client::dropped() const {
+    return m_ring->dropped.load(std::memory_order_relaxed);
+}
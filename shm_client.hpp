@@ -0,0 +1,73 @@
+#ifndef __GPC_SHM_CLIENT_HPP_INCLUDED__
+#define __GPC_SHM_CLIENT_HPP_INCLUDED__
+
+#include <cstddef>
+#include "shm.hpp"
+
+namespace gpc {
+
+    /**
+     * Client library for a gpc server started with --shm.
+     *
+     * Requests are written in place into the shared request ring, responses are
+     * read from a response ring of the client. Neither needs a syscall unless the
+     * other side sleeps. A client may not have more than shm_response_slots
+     * requests in flight, and one client must only be used by one thread.
+     */
+    class shm_client {
+    public:
+
+        /**
+         * Attach to the named segment and claim a response ring.
+         *
+         * Takes over the ring of a client which died without releasing it if no
+         * ring is free.
+         */
+        shm_client(const char* name);
+
+        /**
+         * Release the response ring and detach.
+         */
+        ~shm_client();
+
+        /**
+         * Submit an expression, returns false if the request ring is full.
+         */
+        bool submit(uint64_t id, const char* expression, size_t length);
+
+        /**
+         * Fetch the next response if there is one.
+         *
+         * Responses to requests of a previous owner of the ring are skipped.
+         */
+        bool poll(shm_response& response);
+
+        /**
+         * Wait for the next response, spinning first and sleeping on a futex after.
+         */
+        void wait(shm_response& response);
+
+        /**
+         * Number of responses the server dropped because the ring was full.
+         *
+         * Their requests are never answered, a client which keeps no more than
+         * shm_response_slots requests in flight and reads its responses never
+         * loses any.
+         */
+        uint32_t dropped() const;
+
+    private:
+        shm_segment* m_segment;
+        uint32_t m_pid;
+        uint32_t m_client;
+        uint32_t m_generation;
+        shm_response_ring* m_ring;
+
+        // not copyable
+        shm_client(const shm_client&);
+        shm_client& operator=(const shm_client&);
+    };
+
+}
+
+#endif //__GPC_SHM_CLIENT_HPP_INCLUDED__
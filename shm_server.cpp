@@ -0,0 +1,141 @@
+#include <time.h>
+#include <algorithm>
+#include <cstring>
+#include "futex.hpp"
+#include "shm_server.hpp"
+
+using namespace gpc;
+
+/**
+ * The server looks at the stop flag at least this often while sleeping.
+ */
+static const long sleep_timeout_ms = 100;
+
+/**
+ * A slot which is claimed but not published for that long is skipped if its claimant is gone.
+ */
+static const long long abandoned_timeout_ms = 1000;
+
+/**
+ * Current value of the monotonic clock in milliseconds.
+ */
+static long long now_ms() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return static_cast<long long>(now.tv_sec) * 1000 + now.tv_nsec / 1000000;
+}
+
+/**
+ * Whether the slot at 'head' in the given state was claimed by a producer which died before publishing it.
+ *
+ * 'claimed_since' keeps the time since when the slot is known to be claimed, 0 if it is not.
+ */
+static bool abandoned(uint64_t state, uint32_t head, long long& claimed_since) {
+    uint32_t claimant = shm_slot_claimant(state);
+    if (shm_slot_sequence(state) != head || claimant == 0) {
+        // not claimed at all, the ring is just empty
+        claimed_since = 0;
+        return false;
+    }
+
+    long long now = now_ms();
+    if (claimed_since == 0) {
+        claimed_since = now;
+        return false;
+    }
+
+    return now - claimed_since >= abandoned_timeout_ms && shm_process_gone(claimant);
+}
+
+/**
+ * Sleep until the request at 'head' is published (or a timeout).
+ */
+static void wait_for_request(shm_segment& segment, uint32_t head) {
+    uint32_t signal = segment.request_signal.load(std::memory_order_acquire);
+
+    segment.server_waiting.store(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (shm_slot_sequence(segment.requests[head % shm_request_slots].state.load(std::memory_order_relaxed)) != head + 1) {
+        futex_wait(segment.request_signal, signal, sleep_timeout_ms);
+    }
+    segment.server_waiting.store(0, std::memory_order_relaxed);
+}
+
+/**
+ * Append the outcome to the response ring of the client.
+ */
+static void respond(shm_segment& segment, uint32_t client, uint32_t generation, uint64_t id, const outcome& result) {
+    shm_response_ring& ring = segment.responses[client % shm_clients];
+    uint32_t tail = ring.tail.load(std::memory_order_relaxed);
+
+    if (ring.owner.load(std::memory_order_relaxed) == 0 || ring.generation.load(std::memory_order_relaxed) != generation) {
+        // the client is gone, or the ring has been taken over since the request
+        return;
+    }
+
+    if (tail - ring.head.load(std::memory_order_acquire) >= shm_response_slots) {
+        // the client has more requests in flight than it may or stopped reading,
+        // waiting for it would stall all the other clients
+        ring.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    shm_response& response = ring.slots[tail % shm_response_slots];
+    response.id = id;
+    response.generation = generation;
+    response.kind = result.kind;
+    response.value = result.value;
+    size_t length = std::min(result.message.size(), shm_message_size - 1);
+    std::memcpy(response.message, result.message.data(), length);
+    response.message[length] = '\0';
+
+    ring.tail.store(tail + 1, std::memory_order_release);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (ring.waiting.load(std::memory_order_relaxed)) {
+        futex_wake(ring.tail);
+    }
+}
+
+void gpc::shm_serve(shm_segment& segment, const evaluation_options& options, volatile std::sig_atomic_t& stop) {
+    uint32_t head = segment.request_head.load(std::memory_order_relaxed);
+    unsigned int idle = 0;
+    long long claimed_since = 0;
+    std::string line;
+    outcome result;
+
+    while (!stop) {
+        shm_request& request = segment.requests[head % shm_request_slots];
+
+        if (shm_slot_sequence(request.state.load(std::memory_order_acquire)) != head + 1) {
+            if (++idle > futex_spins()) {
+                idle = 0;
+                wait_for_request(segment, head);
+
+                uint64_t state = request.state.load(std::memory_order_acquire);
+                if (abandoned(state, head, claimed_since)
+                        && request.state.compare_exchange_strong(state, shm_slot_state(head + shm_request_slots, 0), std::memory_order_acq_rel)) {
+                    // the slot of the dead producer goes back without an answer
+                    segment.request_head.store(++head, std::memory_order_relaxed);
+                    claimed_since = 0;
+                }
+            }
+            continue;
+        }
+        idle = 0;
+        claimed_since = 0;
+
+        line.assign(request.expression, std::min<size_t>(request.length, shm_expression_size));
+        uint32_t client = request.client;
+        uint32_t generation = request.generation;
+        uint64_t id = request.id;
+
+        // the request is copied, hand the slot back to the producers right away
+        request.state.store(shm_slot_state(head + shm_request_slots, 0), std::memory_order_release);
+        segment.request_head.store(++head, std::memory_order_relaxed);
+
+        // request ids are chosen by the clients, so they only identify a line together with the client
+        evaluate(line, options, result, id, client % shm_clients + 1);
+        respond(segment, client, generation, id, result);
+    }
+}
@@ -0,0 +1,20 @@
+#ifndef __GPC_SHM_SERVER_HPP_INCLUDED__
+#define __GPC_SHM_SERVER_HPP_INCLUDED__
+
+#include <csignal>
+#include "evaluation.hpp"
+#include "shm.hpp"
+
+namespace gpc {
+
+    /**
+     * Evaluate the requests of a shared memory segment until 'stop' is set.
+     *
+     * The server spins for a while when there is nothing to do and then sleeps on
+     * a futex, waking up regularly to look at 'stop'.
+     */
+    void shm_serve(shm_segment& segment, const evaluation_options& options, volatile std::sig_atomic_t& stop);
+
+}
+
+#endif //__GPC_SHM_SERVER_HPP_INCLUDED__
@@ -0,0 +1,78 @@
+#ifndef __GPC_SPSC_QUEUE_HPP_INCLUDED__
+#define __GPC_SPSC_QUEUE_HPP_INCLUDED__
+
+#include <atomic>
+#include <stdint.h>
+#include "futex.hpp"
+
+namespace gpc {
+
+    /**
+     * Bounded lock-free queue between one producer thread and one consumer thread.
+     *
+     * The consumer spins for a while on an empty queue and then sleeps on a futex.
+     * The producer never waits, it has to make sure there is room (for example by
+     * never having more items than Size in circulation).
+     */
+    template <typename T, uint32_t Size>
+    class spsc_queue {
+    public:
+        static_assert((Size & (Size - 1)) == 0, "the size must be a power of two");
+
+        spsc_queue() : m_head(0), m_tail(0), m_waiting(0) {}
+
+        /**
+         * Append an item, there has to be room for it.
+         */
+        void push(const T& item) {
+            uint32_t head = m_head.load(std::memory_order_relaxed);
+            m_items[head % Size] = item;
+            m_head.store(head + 1, std::memory_order_release);
+
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (m_waiting.load(std::memory_order_relaxed)) {
+                futex_wake(m_head);
+            }
+        }
+
+        /**
+         * Take the oldest item, waiting for one if the queue is empty.
+         */
+        T pop() {
+            uint32_t tail = m_tail.load(std::memory_order_relaxed);
+
+            for (unsigned int idle = 0; m_head.load(std::memory_order_acquire) == tail; ) {
+                if (++idle > futex_spins()) {
+                    idle = 0;
+                    m_waiting.store(1, std::memory_order_relaxed);
+                    std::atomic_thread_fence(std::memory_order_seq_cst);
+                    if (m_head.load(std::memory_order_relaxed) == tail) {
+                        futex_wait(m_head, tail);
+                    }
+                    m_waiting.store(0, std::memory_order_relaxed);
+                }
+            }
+
+            T item = m_items[tail % Size];
+            m_tail.store(tail + 1, std::memory_order_release);
+
+            return item;
+        }
+
+        /**
+         * Whether the queue is empty, only meaningful for the consumer.
+         */
+        bool empty() const {
+            return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_relaxed);
+        }
+
+    private:
+        alignas(64) std::atomic<uint32_t> m_head;
+        alignas(64) std::atomic<uint32_t> m_tail;
+        std::atomic<uint32_t> m_waiting;
+        alignas(64) T m_items[Size];
+    };
+
+}
+
+#endif //__GPC_SPSC_QUEUE_HPP_INCLUDED__
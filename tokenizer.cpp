@@ -1,4 +1,3 @@
-#include <iostream>
 #include <cctype>
 #include "tokenizer.hpp"
 
@@ -7,7 +6,7 @@ using namespace gpc;
 /**
  * Characters which will be trimmed.
  */
-static const std::string white_spaces(" \f\n\r\t\v");
+static const char white_spaces[] = " \f\n\r\t\v";
 
 /**
  * Returns a new string where the trailing and leading whitspaces are trimmed.
@@ -24,19 +23,6 @@ static std::string string_trim(const std::string& str) {
     return result;
 }
 
-/**
- * Splits the 'source' string at 'delimiter' and stores the substrings in 'result'.
- */
-static void string_split(const std::string& source, const std::string& delimiter, std::vector<std::string>& result) {
-    size_t  start = 0, end = 0;
-    
-    while (end != std::string::npos) {
-        end = source.find(delimiter, start);
-        result.push_back(source.substr(start,(end == std::string::npos) ? std::string::npos : end - start));
-        start = ((end > (std::string::npos - delimiter.size())) ?  std::string::npos : end + delimiter.size());
-    }
-}
-
 /**
  * Returns true if a string only contains digits.
  */
@@ -50,32 +36,54 @@ static bool string_isdigit(const std::string& source) {
     return true;
 }
 
-token::token(enum token_type type, const std::string value)
-    : type(type), value(value) {
+token::token(enum token_type type, const std::string value, long long number)
+    : type(type), value(value), number(number) {
+}
+
+token::token(long long number)
+    : type(TOKEN_NUMBER), number(number) {
+}
+
+void tokenizer::add_token(const token& token) {
+    if (m_budget) {
+        m_budget->charge_token();
+    }
+    m_tokens.push_back(token);
 }
 
 /**
  * Because whitespaces do matter for lexical numbers we first split by all
  * possible operations and then inspect the remaining payload.
  *
- * Iterates recursive over the operation symbol table map.
+ * Iterates recursive over the operation symbol table map. Every part is
+ * tokenized as soon as it is split off, so the budget is charged while the
+ * line is split and a line which is too long fails before all of it is split.
  */
 void tokenizer::tokenize(symbol_iterator_t it, const std::string& input) {
-    if (it != operation_symbol_table.end()) {
-        // at least one more item in the map left and more splitting needed
-        token_type current_type = it->second;
-        std::string current_value = it->first;
-        std::vector<std::string> split_result;
-        string_split(input, current_value, split_result);
+    if (it->name) {
+        // at least one more item in the table left and more splitting needed
+        token_type current_type = it->type;
+        std::string current_value = it->name;
         it++;
-        for (unsigned int i = 0; i < split_result.size(); i++) {            
-            if (i != 0) {
-                // if we have more than 1 result than we have a match and
-                // we have to remember the operation as token
-                m_tokens.push_back(token(current_type, current_value));
+
+        size_t end = input.find(current_value);
+        if (end == std::string::npos) {
+            // nothing to split, do not copy the input
+            tokenize(it, input);
+            return;
+        }
+
+        size_t start = 0;
+        for (;;) {
+            // tokenize the part with the next entry in the operation symbol table
+            tokenize(it, input.substr(start, end == std::string::npos ? std::string::npos : end - start));
+            if (end == std::string::npos) {
+                break;
             }
-            // tokenize the result with the next entry in the operation symbol table
-            tokenize(it, split_result[i]);
+            // we have a match and have to remember the operation as token
+            add_token(token(current_type, current_value));
+            start = end + current_value.size();
+            end = input.find(current_value, start);
         }
     } else {
         // no more operations left so we're finnaly got an operand
@@ -83,7 +91,7 @@ void tokenizer::tokenize(symbol_iterator_t it, const std::string& input) {
         
         if (operand.size() != 0) {
             if (string_isdigit(operand)) {
-                m_tokens.push_back(token(TOKEN_DIGIT, string_trim(input)));
+                add_token(token(TOKEN_DIGIT, string_trim(input)));
             } else {
                 tokenize_lexical_number(string_trim(input));   
             }   
@@ -97,29 +105,41 @@ void tokenizer::tokenize(symbol_iterator_t it, const std::string& input) {
  * Iterate over all possible lexical number strings for each part of the number.
  */
 void tokenizer::tokenize_lexical_number(const std::string& input) {    
-    std::vector<std::string> split_result;
-    std::vector<std::string>::iterator it;
-    string_split(input, " ", split_result);
-    for (it = split_result.begin(); it != split_result.end(); it++) {
-        if (it->length() != 0) {
+    size_t start = 0;
+    while (start <= input.size()) {
+        size_t end = input.find(' ', start);
+        if (end == std::string::npos) {
+            end = input.size();
+        }
+        std::string word = input.substr(start, end - start);
+        start = end + 1;
+
+        if (word.length() != 0) {
             bool found = false;
-            for (symbol_iterator_t symbol_it = lexical_number_symbol_table.begin(); symbol_it != lexical_number_symbol_table.end(); symbol_it++) {
-                if (*it == symbol_it->first) {
-                    m_tokens.push_back(token(symbol_it->second, symbol_it->first));
+            for (symbol_iterator_t symbol_it = lexical_number_symbol_table; symbol_it->name; symbol_it++) {
+                if (word == symbol_it->name) {
+                    add_token(token(symbol_it->type, symbol_it->name, symbol_it->value));
                     found = true;
+                    break;
                 }
             }
             
             if (!found) {
-                throw "Unkown token '" + *it + "'";
+                if (m_error_position) {
+                    *m_error_position = m_tokens.size();
+                }
+                throw "Unkown token '" + word + "'";
             }
             
         }
     }
 }
 
-tokenizer::tokenizer(const std::string& input) {
-   tokenize(operation_symbol_table.begin(), input);
+tokenizer::tokenizer(const std::string& input, budget* budget, size_t* error_position) : m_budget(budget), m_error_position(error_position) {
+   if (m_budget) {
+       m_budget->charge_bytes(input.size());
+   }
+   tokenize(operation_symbol_table, input);
 
 //    for (token_iterator_t it = m_tokens.begin(); it != m_tokens.end(); it++) {
 //        std::cout << it->type << " - " << it->value << "\n";
@@ -131,70 +151,61 @@ std::vector<token>& tokenizer::tokens() {
 }
 
 /**
- * Fill the operation symbol table with values.
+ * The operation symbols, the table ends with a symbol without name.
  */
-static symbol_table_t create_operation_symbol_table()
-{
-    symbol_table_t result;
-    
-    result.insert(std::make_pair("+", TOKEN_PLUS));
-    result.insert(std::make_pair("plus", TOKEN_PLUS));
-    result.insert(std::make_pair("-", TOKEN_MINUS));
-    result.insert(std::make_pair("minus", TOKEN_MINUS));
-    result.insert(std::make_pair("*", TOKEN_MULTIPLY));
-    result.insert(std::make_pair("times", TOKEN_MULTIPLY));
-    result.insert(std::make_pair("/", TOKEN_DIVIDE));
-    result.insert(std::make_pair("divided by", TOKEN_DIVIDE));    
-
-    return result;
-}
+const symbol tokenizer::operation_symbol_table[] = {
+    { "+", TOKEN_PLUS },
+    { "plus", TOKEN_PLUS },
+    { "-", TOKEN_MINUS },
+    { "minus", TOKEN_MINUS },
+    { "*", TOKEN_MULTIPLY },
+    { "times", TOKEN_MULTIPLY },
+    { "/", TOKEN_DIVIDE },
+    { "divided by", TOKEN_DIVIDE },
+    { 0, TOKEN_PLUS }
+};
 
 /**
- * Fill the lexical number symbol table with values.
+ * The lexical number symbols, the table ends with a symbol without name.
  */
-static symbol_table_t create_lexical_number_symbol_table()
-{
-    symbol_table_t result;
-    
-    result.insert(std::make_pair("zero", TOKEN_LEXICAL_ONNER));
-    result.insert(std::make_pair("one", TOKEN_LEXICAL_ONNER));
-    result.insert(std::make_pair("two", TOKEN_LEXICAL_ONNER));
-    result.insert(std::make_pair("three", TOKEN_LEXICAL_ONNER));
-    result.insert(std::make_pair("four", TOKEN_LEXICAL_ONNER));
-    result.insert(std::make_pair("five", TOKEN_LEXICAL_ONNER));
-    result.insert(std::make_pair("six", TOKEN_LEXICAL_ONNER));
-    result.insert(std::make_pair("seven", TOKEN_LEXICAL_ONNER));
-    result.insert(std::make_pair("eight", TOKEN_LEXICAL_ONNER));
-    result.insert(std::make_pair("nine", TOKEN_LEXICAL_ONNER));
-    
-    result.insert(std::make_pair("ten", TOKEN_LEXICAL_TEENS));
-    result.insert(std::make_pair("eleven", TOKEN_LEXICAL_TEENS));
-    result.insert(std::make_pair("twelve", TOKEN_LEXICAL_TEENS));
-    result.insert(std::make_pair("thirteen", TOKEN_LEXICAL_TEENS));
-    result.insert(std::make_pair("fourteen", TOKEN_LEXICAL_TEENS));
-    result.insert(std::make_pair("fifteen", TOKEN_LEXICAL_TEENS));
-    result.insert(std::make_pair("sixteen", TOKEN_LEXICAL_TEENS));
-    result.insert(std::make_pair("seventeen", TOKEN_LEXICAL_TEENS));
-    result.insert(std::make_pair("eighteen", TOKEN_LEXICAL_TEENS));
-    result.insert(std::make_pair("nineteen", TOKEN_LEXICAL_TEENS));
-    
-    result.insert(std::make_pair("twenty", TOKEN_LEXICAL_TENNER));
-    result.insert(std::make_pair("thirty", TOKEN_LEXICAL_TENNER));
-    result.insert(std::make_pair("forty", TOKEN_LEXICAL_TENNER));
-    result.insert(std::make_pair("fifty", TOKEN_LEXICAL_TENNER));
-    result.insert(std::make_pair("sixty", TOKEN_LEXICAL_TENNER));
-    result.insert(std::make_pair("seventy", TOKEN_LEXICAL_TENNER));
-    result.insert(std::make_pair("eighty", TOKEN_LEXICAL_TENNER));
-    result.insert(std::make_pair("ninety", TOKEN_LEXICAL_TENNER));
-    
-    result.insert(std::make_pair("hundred", TOKEN_LEXICAL_MULTIPLIER));
-    result.insert(std::make_pair("thousand", TOKEN_LEXICAL_MULTIPLIER));
-    result.insert(std::make_pair("million", TOKEN_LEXICAL_MULTIPLIER));
-    
-    result.insert(std::make_pair("and", TOKEN_LEXICAL_AND));
-    
-    return result;
-}
+const symbol tokenizer::lexical_number_symbol_table[] = {
+    { "zero", TOKEN_LEXICAL_ONNER, 0 },
+    { "one", TOKEN_LEXICAL_ONNER, 1 },
+    { "two", TOKEN_LEXICAL_ONNER, 2 },
+    { "three", TOKEN_LEXICAL_ONNER, 3 },
+    { "four", TOKEN_LEXICAL_ONNER, 4 },
+    { "five", TOKEN_LEXICAL_ONNER, 5 },
+    { "six", TOKEN_LEXICAL_ONNER, 6 },
+    { "seven", TOKEN_LEXICAL_ONNER, 7 },
+    { "eight", TOKEN_LEXICAL_ONNER, 8 },
+    { "nine", TOKEN_LEXICAL_ONNER, 9 },
+
+    { "ten", TOKEN_LEXICAL_TEENS, 10 },
+    { "eleven", TOKEN_LEXICAL_TEENS, 11 },
+    { "twelve", TOKEN_LEXICAL_TEENS, 12 },
+    { "thirteen", TOKEN_LEXICAL_TEENS, 13 },
+    { "fourteen", TOKEN_LEXICAL_TEENS, 14 },
+    { "fifteen", TOKEN_LEXICAL_TEENS, 15 },
+    { "sixteen", TOKEN_LEXICAL_TEENS, 16 },
+    { "seventeen", TOKEN_LEXICAL_TEENS, 17 },
+    { "eighteen", TOKEN_LEXICAL_TEENS, 18 },
+    { "nineteen", TOKEN_LEXICAL_TEENS, 19 },
+
+    { "twenty", TOKEN_LEXICAL_TENNER, 20 },
+    { "thirty", TOKEN_LEXICAL_TENNER, 30 },
+    { "forty", TOKEN_LEXICAL_TENNER, 40 },
+    { "fifty", TOKEN_LEXICAL_TENNER, 50 },
+    { "sixty", TOKEN_LEXICAL_TENNER, 60 },
+    { "seventy", TOKEN_LEXICAL_TENNER, 70 },
+    { "eighty", TOKEN_LEXICAL_TENNER, 80 },
+    { "ninety", TOKEN_LEXICAL_TENNER, 90 },
+
+    { "hundred", TOKEN_LEXICAL_MULTIPLIER, 100 },
+    { "thousand", TOKEN_LEXICAL_MULTIPLIER, 1000 },
+    { "million", TOKEN_LEXICAL_MULTIPLIER, 1000000 },
+    { "billion", TOKEN_LEXICAL_MULTIPLIER, 1000000000LL },
+    { "trillion", TOKEN_LEXICAL_MULTIPLIER, 1000000000000LL },
 
-symbol_table_t tokenizer::operation_symbol_table = create_operation_symbol_table();
-symbol_table_t tokenizer::lexical_number_symbol_table = create_lexical_number_symbol_table();
+    { "and", TOKEN_LEXICAL_AND, 0 },
+    { 0, TOKEN_PLUS }
+};
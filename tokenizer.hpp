@@ -3,7 +3,7 @@
 
 #include <string>
 #include <vector>
-#include <map>
+#include "budget.hpp"
 
 namespace gpc {
 
@@ -69,18 +69,36 @@ namespace gpc {
          *
          * For example: five hundred *and* six.
          */
-        TOKEN_LEXICAL_AND
+        TOKEN_LEXICAL_AND,
+
+        /**
+         * A number which is already converted.
+         *
+         * Only from pre-tokenized binary requests, never from the tokenizer.
+         */
+        TOKEN_NUMBER
     };
 
     /**
-     * Convient typedef for easier access to the symbol table map type.
+     * A symbol and its token type.
      */
-    typedef std::map<const char*, token_type> symbol_table_t;
+    struct symbol {
+        const char* name;
+        enum token_type type;
+
+        /**
+         * Integer value of a lexical number symbol.
+         */
+        long long value;
+    };
 
     /**
-     * Convient typedef for easier access to the symbol table map iterator type.
+     * Convenient typedef for easier access to the symbol table iterator type.
+     *
+     * The tables are constant arrays which end with a symbol without name, so they
+     * need no initialization at startup.
      */
-    typedef symbol_table_t::const_iterator symbol_iterator_t;
+    typedef const symbol* symbol_iterator_t;
 
     /**
      * A token from the input string.
@@ -88,9 +106,15 @@ namespace gpc {
      * The input string is splitted into tokens to be analyzed by the parser.
      */
     struct token {
-        token(enum token_type type, std::string value);
+        token(enum token_type type, std::string value, long long number = 0);
+        token(long long number);
         enum token_type type;
         std::string value;
+
+        /**
+         * Value of a TOKEN_NUMBER or of a lexical number word.
+         */
+        long long number;
     };
 
     /**
@@ -111,8 +135,11 @@ namespace gpc {
 
         /**
          * Construct a new tokenizer by tokenizing the given string.
+         *
+         * The length of the string and every token are charged to the budget (if any).
+         * On an unknown word its token index is stored in error_position (if any).
          */
-        tokenizer(const std::string& input);
+        tokenizer(const std::string& input, budget* budget = 0, size_t* error_position = 0);
 
         /**
          * Get a reference to the token list.
@@ -121,16 +148,19 @@ namespace gpc {
 
     private:
         /**
-         * Map of operations (plus, minus, etc) to their token type.
+         * Table of operations (plus, minus, etc) with their token type.
          */
-        static symbol_table_t operation_symbol_table;
+        static const symbol operation_symbol_table[];
 
         /**
-         * Map of lexical numbers strings to thier token type.
+         * Table of lexical number strings with their token type.
          */
-        static symbol_table_t lexical_number_symbol_table;
+        static const symbol lexical_number_symbol_table[];
         std::vector<token> m_tokens;
+        budget* m_budget;
+        size_t* m_error_position;
 
+        void add_token(const token& token);
         void tokenize(symbol_iterator_t it, const std::string& input);
         void tokenize_lexical_number(const std::string& input);
     };
@@ -0,0 +1,567 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include "futex.hpp"
+#include "io.hpp"
+#include "trace.hpp"
+
+using namespace gpc;
+
+/**
+ * Number of events in a chunk.
+ */
+static const uint32_t chunk_events = 1024;
+
+/**
+ * Number of chunks which may exist at the same time (about 100 bytes per event).
+ *
+ * This is how far all threads together may get ahead of the flusher before
+ * events are dropped.
+ */
+static const unsigned int max_chunks = 1024;
+
+/**
+ * Number of threads which can be traced.
+ */
+static const unsigned int max_threads = 64;
+
+/**
+ * Raw events recorded by one thread.
+ *
+ * A thread fills a chunk of its own without any synchronization and hands it
+ * over to the flusher when it is full.
+ */
+struct trace_chunk {
+    trace_chunk(unsigned int thread) : next(0), thread(thread), count(0) {}
+    trace_chunk* next;
+    unsigned int thread;
+    uint32_t count;
+    trace_event events[chunk_events];
+};
+
+/**
+ * The chunks of a traced thread.
+ */
+struct trace_thread {
+    trace_thread(unsigned int thread) : thread(thread), current(0), spare(0) {}
+    unsigned int thread;
+
+    /**
+     * The chunk being filled, only touched by the thread itself (and by trace_stop()).
+     */
+    trace_chunk* current;
+
+    /**
+     * An empty chunk the flusher handed back for reuse.
+     */
+    std::atomic<trace_chunk*> spare;
+};
+
+// all of the state is constant initialized, tracing costs nothing at startup when unused
+static std::atomic<bool> enabled(false);
+static std::atomic<bool> stopping(false);
+static std::atomic<unsigned int> thread_count(0);
+static std::atomic<trace_thread*> threads[max_threads];
+static std::atomic<unsigned int> chunk_count(0);
+static std::atomic<trace_chunk*> full_chunks(0);
+static std::atomic<uint32_t> flusher_signal(0);
+static std::atomic<uint32_t> flusher_waiting(0);
+static std::atomic<unsigned long long> dropped(0);
+static thread_local trace_thread* current_thread = 0;
+static std::thread* flusher = 0;
+static output_buffer* file = 0;
+static int file_fd = -1;
+static bool first_event = true;
+
+static const char* const span_names[] = { "line", "tokenizer", "parser", "eval" };
+static const char* const outcome_names[] = { "value", "error", "limit" };
+
+/**
+ * Length of the well-formed UTF-8 sequence of a non-ASCII character at 'text', 0 if it is broken.
+ */
+static size_t utf8_sequence_length(const unsigned char* text) {
+    unsigned char c = text[0];
+    size_t length;
+    unsigned char min_second = 0x80;
+    unsigned char max_second = 0xbf;
+
+    if (c >= 0xc2 && c <= 0xdf) {
+        length = 2;
+    } else if (c >= 0xe0 && c <= 0xef) {
+        length = 3;
+        // no overlong forms and no surrogates
+        min_second = (c == 0xe0) ? 0xa0 : 0x80;
+        max_second = (c == 0xed) ? 0x9f : 0xbf;
+    } else if (c >= 0xf0 && c <= 0xf4) {
+        length = 4;
+        // no overlong forms and nothing above U+10FFFF
+        min_second = (c == 0xf0) ? 0x90 : 0x80;
+        max_second = (c == 0xf4) ? 0x8f : 0xbf;
+    } else {
+        return 0;
+    }
+
+    if (text[1] < min_second || text[1] > max_second) {
+        return 0;
+    }
+    for (size_t i = 2; i < length; i++) {
+        if (text[i] < 0x80 || text[i] > 0xbf) {
+            return 0;
+        }
+    }
+
+    return length;
+}
+
+/**
+ * Write the string as JSON string content.
+ *
+ * Lines may contain any bytes, broken UTF-8 is replaced with U+FFFD to keep the file valid JSON.
+ */
+static void write_escaped(output_buffer& out, const char* text) {
+    while (*text) {
+        unsigned char c = static_cast<unsigned char>(*text);
+        if (c == '"' || c == '\\') {
+            out.put('\\');
+            out.put(static_cast<char>(c));
+        } else if (c < 0x20) {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out.write(escaped);
+        } else if (c >= 0x80) {
+            size_t length = utf8_sequence_length(reinterpret_cast<const unsigned char*>(text));
+            if (length == 0) {
+                out.write("\\ufffd");
+                text++;
+            } else {
+                out.write(text, length);
+                text += length;
+            }
+            continue;
+        } else {
+            out.put(static_cast<char>(c));
+        }
+        text++;
+    }
+}
+
+/**
+ * Start a new entry of the traceEvents array.
+ */
+static void begin_event(output_buffer& out) {
+    out.write(first_event ? "\n" : ",\n");
+    first_event = false;
+}
+
+/**
+ * Builds the text of an event without going through printf.
+ */
+struct event_text {
+    event_text() : pos(text) {}
+    char text[256];
+    char* pos;
+
+    void append(const char* string) {
+        while (*string) {
+            *pos++ = *string++;
+        }
+    }
+
+    void append(unsigned long long value) {
+        char digits[20];
+        char* digit = digits + sizeof(digits);
+        do {
+            *--digit = static_cast<char>('0' + value % 10);
+            value /= 10;
+        } while (value != 0);
+        while (digit != digits + sizeof(digits)) {
+            *pos++ = *digit++;
+        }
+    }
+
+    /**
+     * Append nanoseconds as microseconds with three decimals, the unit of the file.
+     */
+    void append_micros(long long ns) {
+        if (ns < 0) {
+            *pos++ = '-';
+            ns = -ns;
+        }
+        append(static_cast<unsigned long long>(ns / 1000));
+        int fraction = static_cast<int>(ns % 1000);
+        *pos++ = '.';
+        *pos++ = static_cast<char>('0' + fraction / 100);
+        *pos++ = static_cast<char>('0' + fraction / 10 % 10);
+        *pos++ = static_cast<char>('0' + fraction % 10);
+    }
+
+    /**
+     * Append the id of an async line span, lines of different shm clients may have the same id.
+     */
+    void append_id(const trace_event& event) {
+        *pos++ = '"';
+        if (event.client != 0) {
+            append(static_cast<unsigned long long>(event.client));
+            *pos++ = ':';
+        }
+        append(static_cast<unsigned long long>(event.line));
+        *pos++ = '"';
+    }
+
+    void write(output_buffer& out) {
+        out.write(text, static_cast<size_t>(pos - text));
+        pos = text;
+    }
+};
+
+/**
+ * Write a span of one stage as a complete event on the thread which ran it.
+ *
+ * Line spans become a pair of async events keyed by the line instead, because
+ * the stages of a line may run on different threads (with --pipeline).
+ */
+static void write_event(output_buffer& out, unsigned int thread, const trace_event& event) {
+    event_text text;
+
+    begin_event(out);
+    text.append("{\"name\":\"");
+    text.append(span_names[event.kind]);
+    if (event.kind != SPAN_LINE) {
+        text.append("\",\"cat\":\"gpc\",\"ph\":\"X\",\"pid\":1,\"tid\":");
+        text.append(static_cast<unsigned long long>(thread));
+        text.append(",\"ts\":");
+        text.append_micros(event.start_ns);
+        text.append(",\"dur\":");
+        text.append_micros(event.duration_ns);
+        text.append(",\"args\":{\"line\":");
+        text.append(static_cast<unsigned long long>(event.line));
+        text.append("}}");
+        text.write(out);
+        return;
+    }
+
+    text.append("\",\"cat\":\"gpc\",\"ph\":\"b\",\"id\":");
+    text.append_id(event);
+    text.append(",\"pid\":1,\"tid\":");
+    text.append(static_cast<unsigned long long>(thread));
+    text.append(",\"ts\":");
+    text.append_micros(event.start_ns);
+    text.append(",\"args\":{\"line\":");
+    text.append(static_cast<unsigned long long>(event.line));
+    if (event.client != 0) {
+        text.append(",\"client\":");
+        text.append(static_cast<unsigned long long>(event.client));
+    }
+    text.append(",\"tokens\":");
+    text.append(static_cast<unsigned long long>(event.tokens));
+    text.append(",\"nodes\":");
+    text.append(static_cast<unsigned long long>(event.nodes));
+    text.append(",\"outcome\":\"");
+    text.append(outcome_names[event.outcome]);
+    text.append("\",\"expression\":\"");
+    text.write(out);
+    write_escaped(out, event.excerpt);
+    out.write("\"}}");
+
+    begin_event(out);
+    text.append("{\"name\":\"");
+    text.append(span_names[event.kind]);
+    text.append("\",\"cat\":\"gpc\",\"ph\":\"e\",\"id\":");
+    text.append_id(event);
+    text.append(",\"pid\":1,\"tid\":");
+    text.append(static_cast<unsigned long long>(thread));
+    text.append(",\"ts\":");
+    text.append_micros(event.start_ns + event.duration_ns);
+    text.append("}");
+    text.write(out);
+}
+
+/**
+ * Write the events of a chunk into the file and hand the chunk back to its thread (or free it).
+ */
+static void write_chunk(trace_chunk* chunk) {
+    for (uint32_t i = 0; i < chunk->count; i++) {
+        write_event(*file, chunk->thread, chunk->events[i]);
+    }
+
+    chunk->count = 0;
+    trace_chunk* empty = 0;
+    trace_thread* owner = threads[chunk->thread - 1].load(std::memory_order_acquire);
+    if (!owner->spare.compare_exchange_strong(empty, chunk, std::memory_order_release)) {
+        delete chunk;
+        chunk_count.fetch_sub(1, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * Take all full chunks, the oldest first.
+ */
+static trace_chunk* take_full_chunks() {
+    trace_chunk* chunks = full_chunks.exchange(0, std::memory_order_acquire);
+    trace_chunk* oldest_first = 0;
+
+    while (chunks) {
+        trace_chunk* next = chunks->next;
+        chunks->next = oldest_first;
+        oldest_first = chunks;
+        chunks = next;
+    }
+
+    return oldest_first;
+}
+
+/**
+ * Writes full chunks as the threads hand them over, sleeps on a futex in between.
+ */
+static void flush_loop() {
+    for (;;) {
+        uint32_t signal = flusher_signal.load(std::memory_order_acquire);
+        trace_chunk* chunks = take_full_chunks();
+
+        if (!chunks) {
+            if (stopping.load(std::memory_order_acquire)) {
+                return;
+            }
+            file->flush();
+
+            flusher_waiting.store(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (!full_chunks.load(std::memory_order_relaxed) && !stopping.load(std::memory_order_relaxed)) {
+                futex_wait(flusher_signal, signal);
+            }
+            flusher_waiting.store(0, std::memory_order_relaxed);
+            continue;
+        }
+
+        while (chunks) {
+            trace_chunk* next = chunks->next;
+            write_chunk(chunks);
+            chunks = next;
+        }
+    }
+}
+
+/**
+ * Wake the flusher, unless it is busy anyway.
+ */
+static void notify_flusher() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (flusher_waiting.load(std::memory_order_relaxed)) {
+        flusher_signal.fetch_add(1, std::memory_order_release);
+        futex_wake(flusher_signal);
+    }
+}
+
+/**
+ * Hand a full chunk over to the flusher.
+ */
+static void publish(trace_chunk* chunk) {
+    trace_chunk* head = full_chunks.load(std::memory_order_relaxed);
+    do {
+        chunk->next = head;
+    } while (!full_chunks.compare_exchange_weak(head, chunk, std::memory_order_release, std::memory_order_relaxed));
+
+    notify_flusher();
+}
+
+/**
+ * An empty chunk for the calling thread, 0 if the flusher is too far behind.
+ */
+static trace_chunk* next_chunk(trace_thread* thread) {
+    trace_chunk* chunk = thread->spare.exchange(0, std::memory_order_acquire);
+    if (chunk) {
+        return chunk;
+    }
+
+    if (chunk_count.fetch_add(1, std::memory_order_relaxed) >= max_chunks) {
+        chunk_count.fetch_sub(1, std::memory_order_relaxed);
+        return 0;
+    }
+
+    return new trace_chunk(thread->thread);
+}
+
+/**
+ * Register the calling thread, 0 if there are too many threads.
+ */
+static trace_thread* register_thread() {
+    unsigned int thread = thread_count.fetch_add(1, std::memory_order_relaxed);
+    if (thread >= max_threads) {
+        return 0;
+    }
+
+    trace_thread* result = new trace_thread(thread + 1);
+    threads[thread].store(result, std::memory_order_release);
+
+    return result;
+}
+
+bool gpc::trace_start(const char* path) {
+    file_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (file_fd < 0) {
+        return false;
+    }
+
+    file = new output_buffer(file_fd);
+    file->write("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    begin_event(*file);
+    file->write("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"gpc\"}}");
+
+    enabled.store(true, std::memory_order_release);
+    flusher = new std::thread(flush_loop);
+
+    return true;
+}
+
+void gpc::trace_stop() {
+    if (!flusher) {
+        return;
+    }
+
+    enabled.store(false, std::memory_order_release);
+    stopping.store(true, std::memory_order_release);
+    flusher_signal.fetch_add(1, std::memory_order_release);
+    futex_wake(flusher_signal);
+    flusher->join();
+    delete flusher;
+    flusher = 0;
+
+    // the chunks the threads were still filling
+    unsigned int count = std::min(thread_count.load(std::memory_order_acquire), max_threads);
+    for (unsigned int i = 0; i < count; i++) {
+        trace_thread* thread = threads[i].load(std::memory_order_acquire);
+        if (thread && thread->current) {
+            write_chunk(thread->current);
+            thread->current = 0;
+        }
+    }
+
+    event_text text;
+    text.append("\n],\"otherData\":{\"dropped_events\":");
+    text.append(dropped.load());
+    text.append("}}\n");
+    text.write(*file);
+    delete file;
+    file = 0;
+    close(file_fd);
+
+    if (dropped.load() != 0) {
+        output_buffer err(2);
+        text.append("gpc: ");
+        text.append(dropped.load());
+        text.append(" trace events were dropped, the trace is incomplete\n");
+        text.write(err);
+    }
+}
+
+bool gpc::trace_enabled() {
+    return enabled.load(std::memory_order_relaxed);
+}
+
+long long gpc::trace_now() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return static_cast<long long>(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+void gpc::trace_record(const trace_event& event) {
+    if (!current_thread) {
+        current_thread = register_thread();
+        if (!current_thread) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    }
+
+    trace_chunk* chunk = current_thread->current;
+    if (!chunk) {
+        chunk = current_thread->current = next_chunk(current_thread);
+        if (!chunk) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    }
+
+    chunk->events[chunk->count++] = event;
+    if (chunk->count == chunk_events) {
+        publish(chunk);
+        current_thread->current = 0;
+    }
+}
+
+line_trace::line_trace()
+    : m_enabled(false), m_id(0), m_client(0), m_stage(SPAN_TOKENIZER), m_start(0), m_last(0) {
+    m_excerpt[0] = '\0';
+}
+
+void line_trace::start(const std::string& line, uint64_t id, uint32_t client, span_kind first_stage) {
+    m_enabled = trace_enabled();
+    m_id = id;
+    m_client = client;
+    m_stage = first_stage;
+
+    if (m_enabled) {
+        m_start = m_last = trace_now();
+        size_t length = std::min(line.length(), trace_excerpt_size - 1);
+        while (length < line.length() && length > 0 && (static_cast<unsigned char>(line[length]) & 0xc0) == 0x80) {
+            // do not cut a character in two
+            length--;
+        }
+        std::memcpy(m_excerpt, line.data(), length);
+        m_excerpt[length] = '\0';
+    }
+}
+
+void line_trace::next_stage() {
+    if (m_enabled) {
+        long long now = trace_now();
+        trace_record(make_event(m_stage, m_last, now));
+        m_last = now;
+    }
+    m_stage = static_cast<span_kind>(m_stage + 1);
+}
+
+void line_trace::resume() {
+    if (m_enabled) {
+        m_last = trace_now();
+    }
+}
+
+void line_trace::finish(int outcome, size_t tokens, size_t nodes) {
+    if (!m_enabled) {
+        return;
+    }
+
+    long long now = trace_now();
+    if (m_stage <= SPAN_EVAL) {
+        // the stage which failed
+        trace_record(make_event(m_stage, m_last, now));
+    }
+
+    trace_event event = make_event(SPAN_LINE, m_start, now);
+    event.outcome = outcome;
+    event.tokens = tokens;
+    event.nodes = nodes;
+    std::memcpy(event.excerpt, m_excerpt, sizeof(m_excerpt));
+    trace_record(event);
+}
+
+trace_event line_trace::make_event(span_kind kind, long long from, long long to) const {
+    trace_event event;
+    event.kind = kind;
+    event.outcome = 0;
+    event.start_ns = from;
+    event.duration_ns = to - from;
+    event.line = m_id;
+    event.client = m_client;
+    event.tokens = 0;
+    event.nodes = 0;
+    event.excerpt[0] = '\0';
+    return event;
+}
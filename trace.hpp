@@ -0,0 +1,135 @@
+#ifndef __GPC_TRACE_HPP_INCLUDED__
+#define __GPC_TRACE_HPP_INCLUDED__
+
+#include <cstddef>
+#include <string>
+#include <stdint.h>
+
+namespace gpc {
+
+    /**
+     * Different kinds of traced spans.
+     */
+    enum span_kind {
+        /**
+         * A whole line, the other spans are nested in it.
+         */
+        SPAN_LINE,
+        SPAN_TOKENIZER,
+        SPAN_PARSER,
+        SPAN_EVAL
+    };
+
+    /**
+     * Length of the excerpt of the line stored with a line span.
+     */
+    const size_t trace_excerpt_size = 48;
+
+    /**
+     * A finished span.
+     */
+    struct trace_event {
+        enum span_kind kind;
+
+        /**
+         * An outcome_kind, only for line spans.
+         */
+        int outcome;
+        long long start_ns;
+        long long duration_ns;
+
+        /**
+         * Id of the line, like its line number.
+         */
+        uint64_t line;
+
+        /**
+         * Number of the shm client (from 1) which sent the line, 0 for other lines.
+         */
+        uint32_t client;
+        size_t tokens;
+        size_t nodes;
+        char excerpt[trace_excerpt_size];
+    };
+
+    /**
+     * Start tracing into a Chrome/Perfetto trace-event JSON file.
+     *
+     * Every thread records its spans into chunks of its own without any
+     * synchronization. A full chunk is handed over to a background thread which
+     * is woken to write it to the file. Events are only dropped (and counted) if
+     * the background thread is so far behind that no chunk is left, rather than
+     * blocking the traced thread. Returns false if the file can not be created.
+     */
+    bool trace_start(const char* path);
+
+    /**
+     * Write the remaining events and finish the file.
+     *
+     * All traced threads must have stopped recording. Warns on stderr if events
+     * were dropped.
+     */
+    void trace_stop();
+
+    /**
+     * Whether spans are traced.
+     */
+    bool trace_enabled();
+
+    /**
+     * Current time for spans in nanoseconds.
+     */
+    long long trace_now();
+
+    /**
+     * Record a span into the chunk of the calling thread.
+     */
+    void trace_record(const trace_event& event);
+
+    /**
+     * Records the span of a line and the spans of its stages.
+     *
+     * The stages may run on different threads, each span ends up in the ring of
+     * the thread which finished it.
+     */
+    class line_trace {
+    public:
+        line_trace();
+
+        /**
+         * A line starts with the given stage.
+         *
+         * The client (if not 0) tells apart lines of different shm clients with the same id.
+         */
+        void start(const std::string& line, uint64_t id, uint32_t client = 0, span_kind first_stage = SPAN_TOKENIZER);
+
+        /**
+         * The running stage is done, the next one starts.
+         */
+        void next_stage();
+
+        /**
+         * The next stage really starts now, the time the line waited for it is not part of its span.
+         */
+        void resume();
+
+        /**
+         * The line is done, successful or not.
+         */
+        void finish(int outcome, size_t tokens, size_t nodes);
+
+    private:
+        bool m_enabled;
+        uint64_t m_id;
+        uint32_t m_client;
+        span_kind m_stage;
+        long long m_start;
+        long long m_last;
+        char m_excerpt[trace_excerpt_size];
+
+        trace_event make_event(span_kind kind, long long from, long long to) const;
+    };
+
+}
+
+#endif //__GPC_TRACE_HPP_INCLUDED__